@@ -46,11 +46,11 @@ static void UnregisterSignalHandler() {
 }
 
 Bot::Bot(XMPPClient *client, Settings &settings)
-	: LemonBot(settings.GetDBPrefixPath() + "/local.db")
+	: LemonBot(":memory:") // modules use per-module files from _storagePool
 	, _xmpp(client)
 	, _settings(settings)
+	, _storagePool(settings.GetDBPrefixPath(), settings)
 {
-	_storage.sync_schema(true);
 	_xmpp->SetXMPPHandler(this);
 	RegisterSignalHandler(this);
 }
@@ -58,6 +58,9 @@ Bot::Bot(XMPPClient *client, Settings &settings)
 Bot::~Bot()
 {
 	UnregisterSignalHandler();
+	_backupTask.reset();
+	if (_manualBackup.valid())
+		_manualBackup.wait();
 }
 
 Bot::ExitCode Bot::Run()
@@ -66,6 +69,8 @@ Bot::ExitCode Bot::Run()
 	_lastMessage = std::chrono::system_clock::now();
 
 	RegisterAllHandlers();
+	StartBackupTimer();
+	ApplyHttpPolicy();
 
 	LOG(INFO) << "Connecting to XMPP server";
 	_xmpp->Connect(_settings.GetUserJID(), _settings.GetPassword());
@@ -171,12 +176,45 @@ void Bot::OnMessage(ChatMessage &msg)
 			SendMessage("Settings successfully reloaded, re-registering handlers...");
 			UnregisterAllHandlers();
 			RegisterAllHandlers();
+			StartBackupTimer();
+			ApplyHttpPolicy();
 			SendMessage("Done");
 		}
 		else
 			SendMessage("Failed to reload settings");
 	}
 
+	if (text == "!backup" && msg._isAdmin)
+	{
+		// FIXME: dirty hack
+		if (msg._module_name != "discord")
+			dynamic_cast<Discord*>(_handlersByName["discord"].get())->HandleMessage(msg);
+
+		if (_manualBackup.valid() && _manualBackup.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return SendMessage("Backup is already running");
+
+		SendMessage("Backup started");
+		return StartBackup();
+	}
+
+	if (text == "!dbstats" && msg._isAdmin)
+	{
+		// FIXME: dirty hack
+		if (msg._module_name != "discord")
+			dynamic_cast<Discord*>(_handlersByName["discord"].get())->HandleMessage(msg);
+
+		return SendMessage(_storagePool.GetQueryReport());
+	}
+
+	if (text == "!httpstats" && msg._isAdmin)
+	{
+		// FIXME: dirty hack
+		if (msg._module_name != "discord")
+			dynamic_cast<Discord*>(_handlersByName["discord"].get())->HandleMessage(msg);
+
+		return SendMessage(_httpClient.GetStats());
+	}
+
 	std::string args;
 	if (getCommandArguments(text, "!help", args))
 	{
@@ -198,6 +236,29 @@ void Bot::OnMessage(ChatMessage &msg)
 }
 
 void Bot::OnPresence(const std::string &nick, const std::string &jid, bool online, const std::string &newNick)
+{
+	bool isNewConnection = UpdateOccupant(nick, jid, online, newNick);
+
+	for (auto &handler : _chatEventHandlers)
+		handler->HandlePresence(nick, jid, isNewConnection);
+}
+
+void Bot::OnPresenceBatch(const std::vector<PresenceUpdate> &batch)
+{
+	// Handlers get the same connected flag HandlePresence would receive
+	std::vector<PresenceUpdate> handlerBatch;
+	handlerBatch.reserve(batch.size());
+	for (const auto &presence : batch)
+	{
+		bool isNewConnection = UpdateOccupant(presence._nick, presence._jid, presence._online, presence._newNick);
+		handlerBatch.push_back({ presence._nick, presence._jid, isNewConnection, presence._newNick });
+	}
+
+	for (auto &handler : _chatEventHandlers)
+		handler->HandlePresenceBatch(handlerBatch);
+}
+
+bool Bot::UpdateOccupant(const std::string &nick, const std::string &jid, bool online, const std::string &newNick)
 {
 	bool isNewConnection = false;
 	if (online)
@@ -217,8 +278,7 @@ void Bot::OnPresence(const std::string &nick, const std::string &jid, bool onlin
 		}
 	}
 
-	for (auto &handler : _chatEventHandlers)
-		handler->HandlePresence(nick, jid, isNewConnection);
+	return isNewConnection;
 }
 
 std::string Bot::GetNickByJid(const std::string &jid) const
@@ -238,6 +298,16 @@ std::string Bot::GetDBPathPrefix() const
 	return _settings.GetDBPrefixPath();
 }
 
+Storage &Bot::GetStorage(const std::string &module)
+{
+	return _storagePool.Get(module);
+}
+
+StorageWorker &Bot::GetStorageWorker(const std::string &module)
+{
+	return _storagePool.GetWorker(module);
+}
+
 std::string Bot::GetOnlineUsers() const
 {
 	std::string result = "Jabber users:";
@@ -348,6 +418,48 @@ bool Bot::EnableHandler(std::shared_ptr<LemonHandler> &handler)
 	return true;
 }
 
+void Bot::StartBackupTimer()
+{
+	_backupTask.reset();
+
+	auto hours = from_string<int>(GetRawConfigValue("Database.BackupHours")).value_or(0);
+	if (hours <= 0)
+		return;
+
+	// First snapshot waits for a full interval, so restarts and !reload don't rotate older generations away
+	LOG(INFO) << "Database snapshots are taken every " << hours << " hours";
+	_backupTask = std::make_unique<PeriodicTask>("db backup", std::chrono::hours(hours), [this] {
+		if (!_storagePool.Backup(GetBackupKeep()))
+			LOG(WARNING) << "Scheduled backup skipped, another one is running";
+	}, false);
+}
+
+void Bot::StartBackup()
+{
+	_manualBackup = std::async(std::launch::async, [this] {
+		auto modules = _storagePool.Backup(GetBackupKeep());
+		if (modules)
+			SendMessage("Backup finished: " + std::to_string(*modules) + " databases saved");
+		else
+			SendMessage("Backup is already running");
+	});
+}
+
+int Bot::GetBackupKeep() const
+{
+	return from_string<int>(GetRawConfigValue("Database.BackupKeep")).value_or(defaultBackupKeep);
+}
+
+void Bot::ApplyHttpPolicy()
+{
+	auto maxPerHost = from_string<int>(GetRawConfigValue("HTTP.MaxPerHost")).value_or(HttpClient::defaultMaxPerHost);
+	auto breakerFailures = from_string<int>(GetRawConfigValue("HTTP.BreakerFailures")).value_or(HttpClient::defaultBreakerFailures);
+	auto breakerOpen = from_string<int>(GetRawConfigValue("HTTP.BreakerOpenSeconds"))
+			.value_or(static_cast<int>(HttpClient::defaultBreakerOpen.count()));
+
+	_httpClient.SetHostPolicy(maxPerHost, breakerFailures, std::chrono::seconds(breakerOpen));
+}
+
 const std::string Bot::GetHelp(const std::string &module) const
 {
 	auto handler = _handlersByName.find(module);
@@ -5,12 +5,15 @@
 #include <mutex>
 #include <memory>
 #include <list>
+#include <future>
 #include <set>
 #include <unordered_map>
 
 #include "xmpphandler.h"
 #include "settings.h"
+#include "storagepool.h"
 #include "handlers/lemonhandler.h"
+#include "handlers/util/periodic_task.h"
 
 class XMPPClient;
 
@@ -35,12 +38,15 @@ public:
 	void OnConnect() override;
 	void OnMessage(ChatMessage &msg) final;
 	void OnPresence(const std::string &nick, const std::string &jid, bool online, const std::string &newNick) final;
+	void OnPresenceBatch(const std::vector<PresenceUpdate> &batch) final;
 
 	// Nick/jid maps
 	std::string GetNickByJid(const std::string &jid) const final;
 	std::string GetJidByNick(const std::string &nick) const final;
 	std::string GetDBPathPrefix() const final;
 	std::string GetOnlineUsers() const final;
+	Storage &GetStorage(const std::string &module) final;
+	StorageWorker &GetStorageWorker(const std::string &module) final;
 
 	// LemonBot interface
 	void SendMessage(const std::string &text, const std::string &module_name = "") final;
@@ -66,12 +72,26 @@ private:
 	bool EnableHandler(const std::string &name);
 	bool EnableHandler(std::shared_ptr<LemonHandler> &handler);
 
+	// Updates nick/jid maps, returns true for new connection
+	bool UpdateOccupant(const std::string &nick, const std::string &jid, bool online, const std::string &newNick);
+
 	// Global commands
 	const std::string GetHelp(const std::string &module) const;
 
+	// Database snapshots
+	void StartBackupTimer();
+	void StartBackup();
+	int GetBackupKeep() const;
+
+	// Per-host limits of the shared HTTP client
+	void ApplyHttpPolicy();
+
 private:
 	std::shared_ptr<XMPPClient> _xmpp;
 	Settings &_settings;
+	StoragePool _storagePool;
+	std::unique_ptr<PeriodicTask> _backupTask;
+	std::future<void> _manualBackup;
 	std::unordered_map<std::string, std::string> _nick2jid;
 	std::unordered_map<std::string, std::string> _jid2nick;
 
@@ -85,4 +105,6 @@ private:
 	std::chrono::system_clock::time_point _lastMessage;
 	std::mutex _sendMessageMutex;
 	int _sendMessageThrottle = 1;
+
+	static constexpr int defaultBackupKeep = 3;
 };
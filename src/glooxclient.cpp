@@ -33,6 +33,8 @@ bool GlooxClient::Disconnect()
 		_room->leave();
 
 	_room.reset();
+	_isJoining = false;
+	_joinPresences.clear();
 
 	if (_client)
 	{
@@ -49,6 +51,9 @@ bool GlooxClient::JoinRoom(const std::string &jid)
 		_room->leave();
 
 	_room = std::make_shared<gloox::MUCRoom>(_client.get(), jid, this, nullptr);
+	_joinPresences.clear();
+	_isJoining = true;
+	_joinStarted = std::chrono::steady_clock::now();
 	_room->join();
 
 	return true;
@@ -110,7 +115,33 @@ void GlooxClient::handleMessage(const gloox::Message &msg, gloox::MessageSession
 void GlooxClient::handleMUCParticipantPresence(gloox::MUCRoom *room, const gloox::MUCRoomParticipant participant, const gloox::Presence &presence)
 {
 	std::string jid = participant.jid ? participant.jid->bare() : "unknown@unknown";
-	_handler->OnPresence(participant.nick->resource(), jid, presence.presence() < gloox::Presence::Unavailable, participant.newNick);
+	PresenceUpdate update = { participant.nick->resource(), jid, presence.presence() < gloox::Presence::Unavailable, participant.newNick };
+
+	if (!_isJoining)
+		return _handler->OnPresence(update._nick, update._jid, update._online, update._newNick);
+
+	// Server sends presences of all occupants first and ours last (XEP-0045 7.2.3)
+	_joinPresences.push_back(std::move(update));
+	bool isTimedOut = std::chrono::steady_clock::now() - _joinStarted > joinTimeout;
+	if (isTimedOut && !(participant.flags & gloox::UserSelf))
+		LOG(WARNING) << "Own presence didn't arrive in " << joinTimeout.count() << " s, passing occupants on without it";
+
+	if ((participant.flags & gloox::UserSelf) || isTimedOut)
+		FlushJoinPresences();
+	else if (_joinPresences.size() >= maxJoinPresences)
+		FlushJoinPresences(false);
+}
+
+void GlooxClient::FlushJoinPresences(bool isJoinDone)
+{
+	_isJoining = !isJoinDone;
+	if (_joinPresences.empty())
+		return;
+
+	LOG(INFO) << (isJoinDone ? "Room joined, " : "Joining room, ") << _joinPresences.size() << " occupants";
+	std::vector<PresenceUpdate> batch;
+	batch.swap(_joinPresences);
+	_handler->OnPresenceBatch(batch);
 }
 
 void GlooxClient::handleMUCMessage(gloox::MUCRoom *room, const gloox::Message &msg, bool priv)
@@ -119,6 +150,10 @@ void GlooxClient::handleMUCMessage(gloox::MUCRoom *room, const gloox::Message &m
 	LOG(INFO) << "MUCMessage: " << msg.body();
 #endif
 
+	// History and subject follow the presences, so our own one isn't coming
+	if (_isJoining)
+		FlushJoinPresences();
+
 	if (msg.when() != nullptr) // history
 	{
 #ifdef EVENT_LOGGING
@@ -144,6 +179,7 @@ void GlooxClient::handleMUCMessage(gloox::MUCRoom *room, const gloox::Message &m
 void GlooxClient::handleMUCError(gloox::MUCRoom *room, gloox::StanzaError error)
 {
 	LOG(ERROR) << "MUC Error: " << error;
+	FlushJoinPresences();
 }
 
 void GlooxClient::handleMUCInviteDecline(gloox::MUCRoom *room, const gloox::JID &invitee, const std::string &reason)
@@ -158,7 +194,8 @@ bool GlooxClient::handleMUCRoomCreation(gloox::MUCRoom *room)
 
 void GlooxClient::handleMUCSubject(gloox::MUCRoom *room, const std::string &nick, const std::string &subject)
 {
-
+	if (_isJoining)
+		FlushJoinPresences();
 }
 
 void GlooxClient::handleMUCInfo(gloox::MUCRoom *room, int features, const std::string &name, const gloox::DataForm *infoForm)
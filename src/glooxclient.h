@@ -8,10 +8,11 @@
 #include <gloox/mucroomhandler.h>
 
 #include <memory>
+#include <vector>
+#include <chrono>
 
 #include "xmppclient.h"
-
-class XMPPHandler;
+#include "xmpphandler.h"
 
 class GlooxClient
 		: public XMPPClient
@@ -52,7 +53,18 @@ private:
 	std::shared_ptr<gloox::Client> _client;
 	std::shared_ptr<gloox::MUCRoom> _room;
 
+	void FlushJoinPresences(bool isJoinDone = true);
+
 	XMPPHandler *_handler = nullptr;
+
+	// Occupant presences are collected until our own presence ends the join burst.
+	// Any other room event or a timeout ends it too, big rooms are passed on in parts
+	bool _isJoining = false;
+	std::chrono::steady_clock::time_point _joinStarted;
+	std::vector<PresenceUpdate> _joinPresences;
+
+	static constexpr size_t maxJoinPresences = 500;
+	static constexpr std::chrono::seconds joinTimeout = std::chrono::seconds(30);
 };
 
 
@@ -10,8 +10,6 @@
 #include <glog/logging.h>
 #include "util/stringops.h"
 
-#include <cpr/cpr.h>
-
 #include <boost/algorithm/string/replace.hpp>
 
 Discord::Discord(LemonBot *bot)
@@ -31,12 +29,13 @@ LemonHandler::ProcessingResult Discord::HandleMessage(const ChatMessage &msg)
 			if (!_users[mappedId]._avatar.empty()) {
 				avatar_url = "https://cdn.discordapp.com/avatars/" + mappedId + "/" + _users[mappedId]._avatar + ".png";
 			}
-			cpr::Post(cpr::Url{_webhookURL},
-					  cpr::Payload{
+			auto response = getHttpClient().Post(_webhookURL, HttpClient::FormEncode({
 						  {"username", msg._nick},
 						  {"content", sanitizeDiscord(msg._body)},
 						  {"avatar_url", avatar_url}
-					  });
+					  }), { "Content-Type: application/x-www-form-urlencoded" });
+			if (response._statusCode < 200 || response._statusCode >= 300)
+				LOG(WARNING) << "Discord webhook failed: " << response._statusCode << " " << response._error;
 
 		} else if (_channelID != 0) {
 			rclientSafeSend(msg._body);
@@ -3,37 +3,113 @@
 #include <glog/logging.h>
 
 #include <ctime>
+#include <algorithm>
 
 #include "util/stringops.h"
 
+static const std::string nicksCounter = "nicks";
+static const std::string usersCounter = "users";
+static constexpr time_t secondsInDay = 24 * 60 * 60;
+static constexpr time_t secondsInWeek = 7 * secondsInDay;
+
+static std::string dayBucket(time_t time)
+{
+	return "d" + std::to_string(time / secondsInDay);
+}
+
+static std::string weekBucket(time_t time)
+{
+	return "w" + std::to_string(time / secondsInWeek);
+}
+
+static void addToCounter(Storage &storage, const std::string &name, long long delta)
+{
+	auto counter = storage.get_no_throw<DB::SeenCounter>(name);
+	storage.replace(DB::SeenCounter{ name, (counter ? counter->value : 0) + delta });
+}
+
+static long long getCounter(Storage &storage, const std::string &name)
+{
+	auto counter = storage.get_no_throw<DB::SeenCounter>(name);
+	return counter ? counter->value : 0;
+}
+
+// Timepoints of user's previous activity tell whether this one is the first in a bucket
+static void rollUp(Storage &storage, time_t previousSeen, time_t previousMessage, time_t now, bool isMessage, bool isNewUser)
+{
+	for (auto period : { secondsInDay, secondsInWeek })
+	{
+		bool isFirstSeen = previousSeen / period < now / period;
+		bool isFirstMessage = isMessage && previousMessage / period < now / period;
+		if (!isFirstSeen && !isFirstMessage && !isNewUser)
+			continue;
+
+		auto bucket = period == secondsInDay ? dayBucket(now) : weekBucket(now);
+		auto existing = storage.get_no_throw<DB::SeenRollup>(bucket);
+		auto rollup = existing ? *existing : DB::SeenRollup{ bucket, 0, 0, 0 };
+		rollup.seen += isFirstSeen;
+		rollup.active += isFirstMessage;
+		rollup.newUsers += isNewUser;
+		storage.replace(rollup);
+	}
+}
+
 LastSeen::LastSeen(LemonBot *bot)
 	: LemonHandler("seen", bot)
 {
 
 }
 
+bool LastSeen::Init()
+{
+	try {
+		for (const auto &nick : getStorage().iterate<DB::Nick>())
+			IndexUser(nick.nick, nick.uniqueID);
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to build nick index: " << e.what();
+		return false;
+	}
+
+	LOG(INFO) << "Nick index built: " << _nickIndex.Size() << " nicks, " << _jidIndex.Size() << " JIDs";
+
+	// Counters are maintained on every write, a full count is only needed once
+	try {
+		if (!getStorage().get_no_throw<DB::SeenCounter>(nicksCounter))
+			getStorage().replace(DB::SeenCounter{ nicksCounter, getStorage().count<DB::Nick>() });
+		if (!getStorage().get_no_throw<DB::SeenCounter>(usersCounter))
+			getStorage().replace(DB::SeenCounter{ usersCounter, getStorage().count<DB::UserActivity>() });
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to seed seen counters: " << e.what();
+		return false;
+	}
+
+	return true;
+}
+
 LemonHandler::ProcessingResult LastSeen::HandleMessage(const ChatMessage &msg)
 {
 	auto now = std::chrono::system_clock::now();
 	auto now_t = std::chrono::system_clock::to_time_t(now);
 
-	try {
-		if (auto userRecord = getStorage().get_no_throw<DB::UserActivity>(msg._jid)) {
-			userRecord->nick = msg._nick;
-			userRecord->message = msg._body;
+	getStorageWorker().Mutate([jid = msg._jid, nick = msg._nick, body = msg._body, now_t](Storage &storage) {
+		if (auto userRecord = storage.get_no_throw<DB::UserActivity>(jid)) {
+			rollUp(storage, std::max(userRecord->timepoint_status, userRecord->timepoint_message),
+				   userRecord->timepoint_message, now_t, true, false);
+			userRecord->nick = nick;
+			userRecord->message = body;
 			userRecord->timepoint_message = now_t;
-			getStorage().update(*userRecord);
+			storage.update(*userRecord);
 		} else {
-			getStorage().replace(DB::UserActivity{msg._jid, msg._nick, msg._body, static_cast<int>(now_t), static_cast<int>(now_t)});
+			rollUp(storage, 0, 0, now_t, true, true);
+			addToCounter(storage, usersCounter, 1);
+			storage.replace(DB::UserActivity{jid, nick, body, static_cast<int>(now_t), static_cast<int>(now_t)});
 		}
-	} catch (std::exception &e) {
-		// get_no_throws throws? debug this
-		LOG(ERROR) << e.what();
-	}
+	});
 
+	// Lookups are queued after pending updates so they see them
 	if (msg._body == "!seenstat")
 	{
-		SendMessage(GetStats());
+		SendMessage(getStorageWorker().Query([this](Storage &storage) { return GetStats(storage); }).get());
 		return ProcessingResult::KeepGoing;
 	}
 
@@ -41,7 +117,7 @@ LemonHandler::ProcessingResult LastSeen::HandleMessage(const ChatMessage &msg)
 	if (!getCommandArguments(msg._body, "!seen", wantedUser))
 		return ProcessingResult::KeepGoing;
 
-	SendMessage(GetUserInfo(wantedUser));
+	SendMessage(getStorageWorker().Query([this, &wantedUser](Storage &storage) { return GetUserInfo(storage, wantedUser); }).get());
 	return ProcessingResult::KeepGoing;
 }
 
@@ -50,40 +126,73 @@ void LastSeen::HandlePresence(const std::string &from, const std::string &jid, b
 	auto now = std::chrono::system_clock::now();
 	auto now_t = std::chrono::system_clock::to_time_t(now);
 
-	using namespace sqlite_orm;
-	DB::Nick newNick{ from, jid };
-	getStorage().replace(newNick);
+	IndexUser(from, jid);
 
-	try {
-		if (auto userRecord = getStorage().get_no_throw<DB::UserActivity>(jid)) {
-			userRecord->nick = from;
-			userRecord->timepoint_status = now_t;
-			getStorage().update(*userRecord);
-		} else {
-			getStorage().replace(DB::UserActivity{jid, from, "", static_cast<int>(now_t), static_cast<int>(now_t)});
-		}
-	} catch (std::exception &e) {
-		// get_no_throws throws? debug this
-		LOG(ERROR) << e.what();
+	getStorageWorker().Mutate([from, jid, now_t](Storage &storage) {
+		StorePresence(storage, from, jid, now_t);
+	});
+}
+
+void LastSeen::HandlePresenceBatch(const std::vector<PresenceUpdate> &batch)
+{
+	auto now_t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+	for (const auto &presence : batch)
+		IndexUser(presence._nick, presence._jid);
+
+	// Whole occupant list is a single job, so it's committed in one transaction
+	getStorageWorker().Mutate([batch, now_t](Storage &storage) {
+		for (const auto &presence : batch)
+			StorePresence(storage, presence._nick, presence._jid, now_t);
+	});
+}
+
+void LastSeen::StorePresence(Storage &storage, const std::string &nick, const std::string &jid, time_t when)
+{
+	if (!storage.get_no_throw<DB::Nick>(nick))
+		addToCounter(storage, nicksCounter, 1);
+	storage.replace(DB::Nick{ nick, jid });
+
+	if (auto userRecord = storage.get_no_throw<DB::UserActivity>(jid)) {
+		rollUp(storage, std::max(userRecord->timepoint_status, userRecord->timepoint_message),
+			   userRecord->timepoint_message, when, false, false);
+		userRecord->nick = nick;
+		userRecord->timepoint_status = when;
+		storage.update(*userRecord);
+	} else {
+		rollUp(storage, 0, 0, when, false, true);
+		addToCounter(storage, usersCounter, 1);
+		// No message timepoint yet, so their first message still counts as active
+		storage.replace(DB::UserActivity{jid, nick, "", static_cast<int>(when), 0});
 	}
 }
 
 const std::string LastSeen::GetHelp() const
 {
-	return "Use !seen %nickname% or !seen %jid%; use !seen %regex% or !seenjid %regex% to search users by regex\n"
-		   "!seenstat - show statistics";
+	return "Use !seen %nickname% or !seen %jid%; if there is no exact match, similar nicks and JIDs are listed\n"
+		   "!seenstat - show statistics: users seen today and this week, active, lurking and new ones";
 }
 
-std::string LastSeen::GetStats()
+std::string LastSeen::GetStats(Storage &storage)
 {
-	auto nick_count = getStorage().count<DB::Nick>();
-	auto user_count = getStorage().count<DB::UserActivity>();
-	return "Seen nicks: " + std::to_string(nick_count) + " | Seen users: " + std::to_string(user_count);
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+
+	auto describe = [&](const std::string &name, const std::string &bucket) {
+		auto existing = storage.get_no_throw<DB::SeenRollup>(bucket);
+		auto rollup = existing ? *existing : DB::SeenRollup{ bucket, 0, 0, 0 };
+		return name + ": " + std::to_string(rollup.seen) + " seen, " + std::to_string(rollup.active) + " active, "
+				+ std::to_string(rollup.seen - rollup.active) + " lurking, " + std::to_string(rollup.newUsers) + " new";
+	};
+
+	return "Seen nicks: " + std::to_string(getCounter(storage, nicksCounter))
+			+ " | Seen users: " + std::to_string(getCounter(storage, usersCounter))
+			+ "\n" + describe("Today", dayBucket(now))
+			+ "\n" + describe("This week", weekBucket(now));
 }
 
-std::string LastSeen::GetUserInfo(const std::string &wantedUser)
+std::string LastSeen::GetUserInfo(Storage &storage, const std::string &wantedUser)
 {
-	auto lastStatus = GetLastStatus(wantedUser);
+	auto lastStatus = GetLastStatus(storage, wantedUser);
 	if (!lastStatus._error.empty())
 		return lastStatus._error;
 
@@ -98,7 +207,7 @@ std::string LastSeen::GetUserInfo(const std::string &wantedUser)
 		result = wantedUser + " (" + lastStatus.jid + ") last seen " + CustomTimeFormat(lastStatus.when) + " ago";
 	}
 
-	if (auto lastActivity = GetLastActive(lastStatus.jid))
+	if (auto lastActivity = GetLastActive(storage, lastStatus.jid))
 	{
 		result.append("; last active " + CustomTimeFormat(lastActivity->when) + " ago");
 		if (!lastActivity->what.empty())
@@ -108,20 +217,20 @@ std::string LastSeen::GetUserInfo(const std::string &wantedUser)
 	return result;
 }
 
-LastSeen::LastStatus LastSeen::GetLastStatus(const std::string &name) // FIXME const
+LastSeen::LastStatus LastSeen::GetLastStatus(Storage &storage, const std::string &name) // FIXME const
 {
 	using namespace sqlite_orm;
 	auto now = std::chrono::system_clock::now();
 
-	if (auto userRecord = getStorage().get_no_throw<DB::UserActivity>(name))
+	if (auto userRecord = storage.get_no_throw<DB::UserActivity>(name))
 	{
 		auto lastSeenTime = std::chrono::system_clock::from_time_t(userRecord->timepoint_status);
 		return { now - lastSeenTime, name, "" };
 	}
 
-	if (auto nick2jid = getStorage().get_no_throw<DB::Nick>(name))
+	if (auto nick2jid = storage.get_no_throw<DB::Nick>(name))
 	{
-		if (auto userRecord = getStorage().get_no_throw<DB::UserActivity>(nick2jid->uniqueID))
+		if (auto userRecord = storage.get_no_throw<DB::UserActivity>(nick2jid->uniqueID))
 		{
 			auto lastSeenTime = std::chrono::system_clock::from_time_t(userRecord->timepoint_status);
 			return { now - lastSeenTime, userRecord->uniqueID, "" };
@@ -130,26 +239,27 @@ LastSeen::LastStatus LastSeen::GetLastStatus(const std::string &name) // FIXME c
 		return { std::chrono::nanoseconds{0}, "", "User activity and nick database mismatch" };
 	}
 
-	auto similarUsers = getStorage().get_all<DB::Nick>(where(like(&DB::Nick::nick, "%" + name + "%")), limit(maxSearchResults));
-	auto similarUsersByJid = getStorage().get_all<DB::Nick>(where(like(&DB::Nick::uniqueID, "%" + name + "%")), limit(maxSearchResults));
-	if (similarUsers.empty())
+	auto similarUsers = _nickIndex.Search(name, maxSearchResults);
+	auto similarUsersByJid = _jidIndex.Search(name, maxSearchResults);
+	if (similarUsers.empty() && similarUsersByJid.empty())
 		return { std::chrono::seconds{0}, "", name + "? Who's that?" };
 	else
 	{
 		std::string similarUsersStr = "Similar nicks:";
 		for (const auto &user : similarUsers)
-			similarUsersStr.append(" " + user.nick + " (" + user.uniqueID + ")");
+			similarUsersStr.append(" " + user._key + " (" + user._payload + ")");
 		similarUsersStr.append("\n\nSimilar JIDs:");
 		for (const auto &user : similarUsersByJid)
-			similarUsersStr.append(" " + user.nick + " (" + user.uniqueID + ")");
+			similarUsersStr.append(" " + user._payload + " (" + user._key + ")");
 		return { std::chrono::seconds{0}, "", similarUsersStr };
 	}
 }
 
-std::optional<LastSeen::LastActivity> LastSeen::GetLastActive(const std::string &jid)
+std::optional<LastSeen::LastActivity> LastSeen::GetLastActive(Storage &storage, const std::string &jid)
 {
 	auto now = std::chrono::system_clock::now();
-	if (auto userRecord = getStorage().get_no_throw<DB::UserActivity>(jid)) {
+	auto userRecord = storage.get_no_throw<DB::UserActivity>(jid);
+	if (userRecord && userRecord->timepoint_message != 0) {
 		auto lastActiveTime = std::chrono::system_clock::from_time_t(userRecord->timepoint_message);
 		return {{ now - lastActiveTime, userRecord->message }};
 	} else {
@@ -157,6 +267,12 @@ std::optional<LastSeen::LastActivity> LastSeen::GetLastActive(const std::string
 	}
 }
 
+void LastSeen::IndexUser(const std::string &nick, const std::string &jid)
+{
+	_nickIndex.Insert(nick, jid);
+	_jidIndex.Insert(jid, nick);
+}
+
 #ifdef _BUILD_TESTS // LCOV_EXCL_START
 
 #include "gtest/gtest.h"
@@ -189,29 +305,97 @@ TEST(LastSeen, GetLastStatus_OnlineOffline)
 	LastSeen test(&tb);
 
 	{
-		EXPECT_FALSE(test.GetLastStatus("test_user")._error.empty());
-		EXPECT_FALSE(test.GetLastStatus("test@test.com")._error.empty());
+		EXPECT_FALSE(test.GetLastStatus(tb._storage, "test_user")._error.empty());
+		EXPECT_FALSE(test.GetLastStatus(tb._storage, "test@test.com")._error.empty());
 	}
 
 	{
 		test.HandlePresence("test_user", "test@test.com", true);
 
-		EXPECT_TRUE(test.GetLastStatus("test_user")._error.empty());
-		EXPECT_EQ("test@test.com", test.GetLastStatus("test_user").jid);
+		EXPECT_TRUE(test.GetLastStatus(tb._storage, "test_user")._error.empty());
+		EXPECT_EQ("test@test.com", test.GetLastStatus(tb._storage, "test_user").jid);
 
-		EXPECT_TRUE(test.GetLastStatus("test@test.com")._error.empty());
-		EXPECT_EQ("test@test.com", test.GetLastStatus("test@test.com").jid);
+		EXPECT_TRUE(test.GetLastStatus(tb._storage, "test@test.com")._error.empty());
+		EXPECT_EQ("test@test.com", test.GetLastStatus(tb._storage, "test@test.com").jid);
 	}
 
 	{
 		test.HandlePresence("test_user", "test@test.com", false);
 
-		EXPECT_TRUE(test.GetLastStatus("test_user")._error.empty());
-		EXPECT_EQ("test@test.com", test.GetLastStatus("test_user").jid);
+		EXPECT_TRUE(test.GetLastStatus(tb._storage, "test_user")._error.empty());
+		EXPECT_EQ("test@test.com", test.GetLastStatus(tb._storage, "test_user").jid);
+
+		EXPECT_TRUE(test.GetLastStatus(tb._storage, "test@test.com")._error.empty());
+		EXPECT_EQ("test@test.com", test.GetLastStatus(tb._storage, "test@test.com").jid);
+	}
+}
 
-		EXPECT_TRUE(test.GetLastStatus("test@test.com")._error.empty());
-		EXPECT_EQ("test@test.com", test.GetLastStatus("test@test.com").jid);
+TEST(LastSeen, GetLastStatus_Similar)
+{
+	LastSeenBot tb;
+
+	{
+		LastSeen test(&tb);
+		test.HandlePresence("test_user", "test@test.com", true);
+		test.HandlePresence("other_user", "other@example.com", true);
 	}
+
+	// Index is rebuilt from storage on init
+	LastSeen test(&tb);
+	ASSERT_TRUE(test.Init());
+
+	auto status = test.GetLastStatus(tb._storage, "user");
+	EXPECT_NE(status._error.npos, status._error.find("test_user (test@test.com)"));
+	EXPECT_NE(status._error.npos, status._error.find("other_user (other@example.com)"));
+
+	status = test.GetLastStatus(tb._storage, "example");
+	EXPECT_EQ(status._error.npos, status._error.find("test_user"));
+	EXPECT_NE(status._error.npos, status._error.find("other_user (other@example.com)"));
+
+	EXPECT_EQ("nobody? Who's that?", test.GetLastStatus(tb._storage, "nobody")._error);
+}
+
+TEST(LastSeen, PresenceBatch)
+{
+	LastSeenBot tb;
+	LastSeen test(&tb);
+
+	std::vector<PresenceUpdate> batch;
+	for (int i = 0; i < 100; i++)
+		batch.push_back({ "user" + std::to_string(i), "user" + std::to_string(i) + "@test.com", true, "" });
+	test.HandlePresenceBatch(batch);
+
+	EXPECT_EQ(100, tb._storage.count<DB::Nick>());
+	EXPECT_EQ(100, tb._storage.count<DB::UserActivity>());
+	EXPECT_EQ("user42@test.com", test.GetLastStatus(tb._storage, "user42").jid);
+	EXPECT_TRUE(test._nickIndex.Contains("user99"));
+}
+
+TEST(LastSeen, Stats)
+{
+	LastSeenBot tb;
+	LastSeen test(&tb);
+
+	// Counters are seeded from existing rows
+	tb._storage.replace(DB::Nick{ "old_user", "old@test.com" });
+	tb._storage.replace(DB::UserActivity{ "old@test.com", "old_user", "", 0, 0 });
+	ASSERT_TRUE(test.Init());
+
+	test.HandlePresence("old_user", "old@test.com", true);
+	test.HandlePresence("alice", "alice@test.com", true);
+	test.HandlePresence("bob", "bob@test.com", true);
+	test.HandleMessage(ChatMessage("alice", "alice@test.com", "", "hello", false));
+	test.HandleMessage(ChatMessage("alice", "alice@test.com", "", "hello again", false));
+	test.HandlePresence("alice_away", "alice@test.com", true);
+
+	auto stats = test.GetStats(tb._storage);
+	EXPECT_NE(stats.npos, stats.find("Seen nicks: 4 | Seen users: 3"));
+	EXPECT_NE(stats.npos, stats.find("Today: 3 seen, 1 active, 2 lurking, 2 new"));
+	EXPECT_NE(stats.npos, stats.find("This week: 3 seen, 1 active, 2 lurking, 2 new"));
+
+	// Presence alone doesn't make anyone active
+	EXPECT_FALSE(test.GetLastActive(tb._storage, "bob@test.com").has_value());
+	EXPECT_EQ("hello again", test.GetLastActive(tb._storage, "alice@test.com").value_or(LastSeen::LastActivity()).what);
 }
 
 #endif // LCOV_EXCL_STOP
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lemonhandler.h"
+#include "util/trigram_index.h"
 
 #include <string>
 #include <chrono>
@@ -13,9 +14,11 @@ class LastSeen : public LemonHandler
 {
 public:
 	LastSeen(LemonBot *bot);
+	bool Init() override;
 	ProcessingResult HandleMessage(const ChatMessage &msg) final;
 
 	void HandlePresence(const std::string &from, const std::string &jid, bool connected) override;
+	void HandlePresenceBatch(const std::vector<PresenceUpdate> &batch) override;
 	const std::string GetHelp() const override;
 
 private:
@@ -36,13 +39,22 @@ private:
 		std::string what;
 	};
 
-	std::string GetStats();
-	std::string GetUserInfo(const std::string &wantedUser);
+	std::string GetStats(Storage &storage);
+	std::string GetUserInfo(Storage &storage, const std::string &wantedUser);
 
-	LastStatus GetLastStatus(const std::string &name);
-	std::optional<LastActivity> GetLastActive(const std::string &jid);
+	LastStatus GetLastStatus(Storage &storage, const std::string &name);
+	std::optional<LastActivity> GetLastActive(Storage &storage, const std::string &jid);
+
+	void IndexUser(const std::string &nick, const std::string &jid);
+	static void StorePresence(Storage &storage, const std::string &nick, const std::string &jid, time_t when);
+
+	TrigramIndex _nickIndex;
+	TrigramIndex _jidIndex;
 
 #ifdef _BUILD_TESTS
 	FRIEND_TEST(LastSeen, GetLastStatus_OnlineOffline);
+	FRIEND_TEST(LastSeen, GetLastStatus_Similar);
+	FRIEND_TEST(LastSeen, PresenceBatch);
+	FRIEND_TEST(LastSeen, Stats);
 #endif
 };
@@ -3,9 +3,8 @@
 #include <glog/logging.h>
 #include <json/reader.h>
 #include <json/value.h>
-#include <cpr/cpr.h>
-#include <cpr/util.h>
 
+#include "util/sqlite_cursor.h"
 #include "util/stringops.h"
 #include "util/thread_util.h"
 
@@ -95,11 +94,11 @@ const std::string LeagueLookup::GetHelp() const
 		   "!listsummoners - list watchlist content";
 }
 
-LeagueLookup::RiotAPIResponse LeagueLookup::RiotAPIRequest(const std::string &request, Json::Value &output)
+LeagueLookup::RiotAPIResponse LeagueLookup::RiotAPIRequest(const std::string &request, Json::Value &output) const
 {
-	auto apiResponse = cpr::Get(request);
+	auto apiResponse = getHttpClient().Get(request);
 
-	switch (apiResponse.status_code)
+	switch (apiResponse._statusCode)
 	{
 	case 403:
 		return RiotAPIResponse::AccessDenied;
@@ -110,7 +109,7 @@ LeagueLookup::RiotAPIResponse LeagueLookup::RiotAPIRequest(const std::string &re
 		return RiotAPIResponse::RateLimitReached;
 	case 200:
 	{
-		const auto &strResponse = apiResponse.text;
+		const auto &strResponse = apiResponse._body;
 
 		Json::Reader reader;
 		if (!reader.parse(strResponse, output))
@@ -122,7 +121,7 @@ LeagueLookup::RiotAPIResponse LeagueLookup::RiotAPIRequest(const std::string &re
 		return RiotAPIResponse::OK;
 	}
 	default:
-		LOG(ERROR) << "RiotAPI unexpected response: " << apiResponse.status_code;
+		LOG(ERROR) << "RiotAPI unexpected response: " << apiResponse._statusCode;
 		return RiotAPIResponse::UnexpectedResponseCode;
 	}
 }
@@ -178,7 +177,7 @@ std::string LeagueLookup::lookupCurrentGame(const std::string &name) const
 
 int LeagueLookup::getSummonerIDFromName(const std::string &name) const
 {
-	std::string apiRequest = "https://" + _api._region + ".api.riotgames.com/lol/summoner/v3/summoners/by-name/" + cpr::util::urlEncode(name) + "?api_key=" + _api._key;
+	std::string apiRequest = "https://" + _api._region + ".api.riotgames.com/lol/summoner/v3/summoners/by-name/" + HttpClient::UrlEncode(name) + "?api_key=" + _api._key;
 
 	Json::Value response;
 
@@ -286,7 +285,7 @@ void LeagueLookup::LookupAllSummoners(LeagueLookup *_parent, ApiOptions &api)
 				+ std::to_string(summoner.summonerID) + "?api_key=" + api._key;
 
 		Json::Value response;
-		switch (RiotAPIRequest(apiRequest, response))
+		switch (_parent->RiotAPIRequest(apiRequest, response))
 		{
 		case RiotAPIResponse::NotFound:
 			break;
@@ -365,8 +364,10 @@ std::string LeagueLookup::ListSummoners()
 {
 	std::string output;
 
-	for (auto &summoner : getStorage().get_all<DB::LLSummoner>())
+	RowCursor<DB::LLSummoner>(getStorage()).ForEach([&](const DB::LLSummoner &summoner) {
 		output.append(std::to_string(summoner.summonerID) + " : " + summoner.nickname + "\n");
+		return true;
+	});
 
 	if (output.empty())
 		return "Watchlist is empty";
@@ -12,6 +12,12 @@ LemonHandler::~LemonHandler()
 
 }
 
+void LemonHandler::HandlePresenceBatch(const std::vector<PresenceUpdate> &batch)
+{
+	for (const auto &presence : batch)
+		HandlePresence(presence._nick, presence._jid, presence._online);
+}
+
 const std::string LemonHandler::GetHelp() const
 {
 	return "This module has no commands";
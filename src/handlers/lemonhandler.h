@@ -2,16 +2,20 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 #include "../xmpphandler.h" // FIXME we need chatmessage only
 
 #include "util/sqlite_db.h"
+#include "util/storage_worker.h"
+#include "util/http_client.h"
 
 class LemonBot
 {
 public:
 	LemonBot(std::string storagePath)
 		: _storage(initStorage(storagePath))
+		, _storageWorker(_storage)
 	{}
 
 	virtual void SendMessage(const std::string &text) {}
@@ -26,9 +30,26 @@ public:
 	virtual std::string GetJidByNick(const std::string &nick) const { return ""; }
 	virtual std::string GetOnlineUsers() const { return ""; }
 	virtual std::string GetDBPathPrefix() const { return "db/"; }
+
+	/**
+	 * @brief Storage for a specific module, shared _storage unless overriden
+	 */
+	virtual Storage &GetStorage(const std::string &module) { return _storage; }
+
+	/**
+	 * @brief Job queue for module storage, synchronous worker over _storage unless overriden
+	 */
+	virtual StorageWorker &GetStorageWorker(const std::string &module) { return _storageWorker; }
+
+	/**
+	 * @brief HTTP client with keep-alive connection pools, shared by all modules
+	 */
+	virtual HttpClient &GetHttpClient() { return _httpClient; }
 	virtual ~LemonBot() {}
 
 	Storage _storage;
+	StorageWorker _storageWorker;
+	HttpClient _httpClient;
 };
 
 class LemonHandler
@@ -61,6 +82,12 @@ public:
 	virtual ProcessingResult HandleMessage(const ChatMessage &msg) = 0;
 	virtual void HandlePresence(const std::string &from, const std::string &jid, bool connected) { }
 
+	/**
+	 * @brief Receives occupant list on room join, _online is the connected flag of HandlePresence
+	 * Calls HandlePresence for every entry unless overriden
+	 */
+	virtual void HandlePresenceBatch(const std::vector<PresenceUpdate> &batch);
+
 	/**
 	 * @brief Get help string
 	 * @return List of module commands and their description
@@ -90,7 +117,7 @@ protected:
 
 	Storage &getStorage() {
 		if (_botPtr)
-			return _botPtr->_storage;
+			return _botPtr->GetStorage(_moduleName);
 		else
 		{
 			static Storage storage = initStorage(":memory:");
@@ -100,11 +127,36 @@ protected:
 
 	const Storage &getStorage() const {
 		if (_botPtr)
-			return _botPtr->_storage;
+			return _botPtr->GetStorage(_moduleName);
 		else
 		{
 			static Storage storage = initStorage(":memory:");
 			return storage;
 		}
 	}
+
+	/**
+	 * @brief Queue for storage jobs that shouldn't block message processing
+	 * Jobs may outlive the handler, so they must not capture it, unless
+	 * the caller waits for the job's future before returning
+	 */
+	StorageWorker &getStorageWorker() {
+		if (_botPtr)
+			return _botPtr->GetStorageWorker(_moduleName);
+		else
+		{
+			static StorageWorker worker(getStorage());
+			return worker;
+		}
+	}
+
+	HttpClient &getHttpClient() const {
+		if (_botPtr)
+			return _botPtr->GetHttpClient();
+		else
+		{
+			static HttpClient client;
+			return client;
+		}
+	}
 };
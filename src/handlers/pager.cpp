@@ -3,7 +3,9 @@
 #include <map>
 #include <algorithm>
 #include <memory>
+#include <unordered_map>
 
+#include "util/sqlite_cursor.h"
 #include "util/stringops.h"
 
 #include <glog/logging.h>
@@ -97,6 +99,45 @@ void Pager::HandlePresence(const std::string &from, const std::string &jid, bool
 	}
 }
 
+void Pager::HandlePresenceBatch(const std::vector<PresenceUpdate> &batch)
+{
+	if (_messages.empty())
+		return;
+
+	// Recipient (jid, or nick for messages paged by nick) -> current nick
+	std::unordered_map<std::string, std::string> arrived;
+	for (const auto &presence : batch)
+	{
+		if (!presence._online)
+			continue;
+		arrived.emplace(presence._jid, presence._nick);
+		if (presence._nick.find('@') == presence._nick.npos)
+			arrived.emplace(presence._nick, presence._nick);
+	}
+
+	if (arrived.empty())
+		return;
+
+	auto now = std::chrono::system_clock::now();
+	auto message = _messages.begin();
+	while (message != _messages.end())
+	{
+		auto nick = arrived.find(message->_recepient);
+		if (nick != arrived.end())
+		{
+			SendMessage(nick->second + "! You have a message >> " + message->_text);
+			PurgeMessageFromDB(message->_id);
+			_messages.erase(message++);
+		} else if (message->_expiration < now) {
+			SendMessage("Message for " + message->_recepient + " (" + message->_text + ") has expired");
+			PurgeMessageFromDB(message->_id);
+			_messages.erase(message++);
+		} else {
+			++message;
+		}
+	}
+}
+
 const std::string Pager::GetHelp() const
 {
 	return "Use !pager %jid% %message% or !pager %nick% %message%. Paged messages are lost after 72 hours. Use !pager_stats to get number of paged messages";
@@ -104,10 +145,10 @@ const std::string Pager::GetHelp() const
 
 void Pager::RestoreMessages()
 {
-	for (auto &msg : getStorage().get_all<DB::PagerMsg>())
-	{
+	RowCursor<DB::PagerMsg>(getStorage()).ForEach([&](const DB::PagerMsg &msg) {
 		_messages.emplace_back(msg);
-	}
+		return true;
+	});
 }
 
 void Pager::StoreMessage(const std::string &to, const std::string &from, const std::string &text)
@@ -229,4 +270,25 @@ TEST(PagerTest, MsgByJidCheckPresenseHandling)
 	EXPECT_EQ("Paged messages: none", testbot._received.back());
 }
 
+TEST(PagerTest, PresenceBatch)
+{
+	PagerTestBot testbot;
+	Pager pager(&testbot);
+
+	pager.HandleMessage(ChatMessage("Bob", "", "", "!pager alice@jabber.com first", false));
+	pager.HandleMessage(ChatMessage("Bob", "", "", "!pager Carol second", false));
+	pager.HandleMessage(ChatMessage("Bob", "", "", "!pager Dave third", false));
+	EXPECT_EQ(3, testbot._received.size());
+
+	pager.HandlePresenceBatch({ { "Alice", "alice@jabber.com", true, "" },
+								{ "Carol", "carol@jabber.com", true, "" },
+								{ "Dave", "dave@jabber.com", false, "" } });
+
+	ASSERT_EQ(5, testbot._received.size());
+	EXPECT_EQ("Alice! You have a message >> Bob: first", testbot._received[3]);
+	EXPECT_EQ("Carol! You have a message >> Bob: second", testbot._received[4]);
+	ASSERT_EQ(1, pager._messages.size());
+	EXPECT_EQ("Dave", pager._messages.front()._recepient);
+}
+
 #endif // LCOV_EXCL_STOP
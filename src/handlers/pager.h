@@ -15,6 +15,7 @@ public:
 	Pager(LemonBot *bot);
 	ProcessingResult HandleMessage(const ChatMessage &msg) final;
 	void HandlePresence(const std::string &from, const std::string &jid, bool connected) override;
+	void HandlePresenceBatch(const std::vector<PresenceUpdate> &batch) override;
 	const std::string GetHelp() const override;
 
 private:
@@ -45,5 +46,6 @@ private:
 	FRIEND_TEST(PagerTest, MsgByNickCheckPresenseHandling);
 	FRIEND_TEST(PagerTest, MsgByJidCheckPresenseHandling);
 	FRIEND_TEST(PagerTest, MessageSerializer);
+	FRIEND_TEST(PagerTest, PresenceBatch);
 #endif
 };
@@ -1,9 +1,15 @@
 #include "quotes.h"
 
 #include <glog/logging.h>
+#include <json/reader.h>
+#include <json/writer.h>
+#include <json/value.h>
 
 #include <chrono>
+#include <fstream>
+#include <vector>
 
+#include "util/sqlite_cursor.h"
 #include "util/stringops.h"
 
 Quotes::Quotes(LemonBot *bot)
@@ -63,7 +69,40 @@ LemonHandler::ProcessingResult Quotes::HandleMessage(const ChatMessage &msg)
 			return ProcessingResult::StopProcessing;
 		}
 
-		RegenerateIndex();
+		auto count = RegenerateIndex();
+		count >= 0
+				? SendMessage("Index regenerated. New count: " + std::to_string(count))
+				: SendMessage("Failed to regenerate index");
+		return ProcessingResult::StopProcessing;
+	}
+
+	if (getCommandArguments(msg._body, "!exportquotes", arg) && !arg.empty())
+	{
+		if (!msg._isAdmin)
+		{
+			SendMessage(msg._nick + ": only admin can export quotes");
+			return ProcessingResult::StopProcessing;
+		}
+
+		if (auto count = ExportQuotes(arg))
+			SendMessage(msg._nick + ": " + std::to_string(*count) + " quotes exported");
+		else
+			SendMessage(msg._nick + ": export failed");
+		return ProcessingResult::StopProcessing;
+	}
+
+	if (getCommandArguments(msg._body, "!importquotes", arg) && !arg.empty())
+	{
+		if (!msg._isAdmin)
+		{
+			SendMessage(msg._nick + ": only admin can import quotes");
+			return ProcessingResult::StopProcessing;
+		}
+
+		if (auto count = ImportQuotes(arg))
+			SendMessage(msg._nick + ": " + std::to_string(*count) + " quotes imported");
+		else
+			SendMessage(msg._nick + ": import failed");
 		return ProcessingResult::StopProcessing;
 	}
 
@@ -74,7 +113,8 @@ const std::string Quotes::GetHelp() const
 {
 	return "!aq %text% - add quote, !dq %id% - delete quote\n"
 		   "!fq %regex% - find quote, !gq %id% - get quote, if id is empty then quote is random\n"
-		   "!regenquotes - regenerate index";
+		   "!regenquotes - regenerate index\n"
+		   "!exportquotes %file% and !importquotes %file% - dump quotes to / load quotes from a JSON lines file in the db directory (admin only)";
 }
 
 std::string Quotes::GetQuote(const std::string &id)
@@ -160,16 +200,163 @@ std::string Quotes::FindQuote(const std::string &request) // FIXME const
 	return searchResults;
 }
 
-void Quotes::RegenerateIndex()
+int Quotes::RegenerateIndex()
 {
+	using namespace sqlite_orm;
+
+	// Only rows whose index actually changes are touched, and all of them
+	// go into a single transaction instead of one autocommit per quote.
+	// Rows are walked in id (rowid) order, updating index doesn't move them
 	int index = 0;
-	for (auto &quote : getStorage().get_all<DB::Quote>())
+	bool committed = false;
+	try {
+		committed = getStorage().transaction([&] {
+			try {
+				RowCursor<DB::Quote>(getStorage()).ForEach([&](const DB::Quote &quote) {
+					if (quote.humanIndex != ++index)
+						getStorage().update_all(set(c(&DB::Quote::humanIndex) = index),
+												where(is_equal(&DB::Quote::id, quote.id)));
+					return true;
+				});
+			} catch (std::exception &e) {
+				LOG(ERROR) << "Failed to regenerate quote index: " << e.what();
+				return false;
+			}
+			return true;
+		});
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to regenerate quote index: " << e.what();
+	}
+
+	return committed ? index : -1;
+}
+
+std::optional<int> Quotes::ExportQuotes(const std::string &fileName)
+{
+	auto path = GetDumpPath(fileName);
+	if (!path)
+		return {};
+
+	std::ofstream dump(*path, std::ios::trunc);
+	if (!dump)
 	{
-		quote.humanIndex = ++index;
-		getStorage().update(quote);
+		LOG(ERROR) << "Can't open " << *path << " for writing";
+		return {};
+	}
+
+	Json::FastWriter writer;
+	int count = 0;
+	try {
+		count = static_cast<int>(RowCursor<DB::Quote>(getStorage()).ForEach([&](const DB::Quote &quote) {
+			Json::Value line;
+			line["index"] = quote.humanIndex;
+			line["quote"] = quote.quote;
+			line["author"] = quote.author;
+			line["author_id"] = quote.author_id;
+			dump << writer.write(line);
+			return true;
+		}));
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to export quotes: " << e.what();
+		return {};
 	}
 
-	SendMessage("Index regenerated. New count: " + std::to_string(index));
+	return count;
+}
+
+std::optional<int> Quotes::ImportQuotes(const std::string &fileName)
+{
+	auto path = GetDumpPath(fileName);
+	if (!path)
+		return {};
+
+	std::ifstream dump(*path);
+	if (!dump)
+	{
+		LOG(ERROR) << "Can't open " << *path << " for reading";
+		return {};
+	}
+
+	// Indices from the dump are ignored, imported quotes are appended
+	// after existing ones in the order they appear in the file
+	int nextIndex = 1;
+	if (auto maxID = getStorage().max(&DB::Quote::humanIndex)) {
+		nextIndex = *maxID + 1;
+	}
+
+	int imported = 0;
+	int skipped = 0;
+	bool committed = false;
+	std::vector<DB::Quote> batch;
+	batch.reserve(importBatchSize);
+
+	try {
+		committed = getStorage().transaction([&] {
+			try {
+				Json::Reader reader;
+				std::string line;
+				while (std::getline(dump, line))
+				{
+					if (line.empty())
+						continue;
+
+					Json::Value value;
+					if (!reader.parse(line, value)
+							|| !value.isObject()
+							|| !value["quote"].isString()
+							|| value["quote"].asString().empty())
+					{
+						++skipped;
+						continue;
+					}
+
+					batch.push_back({ -1, nextIndex++, value["quote"].asString(),
+									  value.get("author", "").asString(),
+									  value.get("author_id", "").asString() });
+
+					if (batch.size() == importBatchSize)
+					{
+						getStorage().insert_range(batch.begin(), batch.end());
+						imported += static_cast<int>(batch.size());
+						batch.clear();
+					}
+				}
+
+				if (!batch.empty())
+				{
+					getStorage().insert_range(batch.begin(), batch.end());
+					imported += static_cast<int>(batch.size());
+				}
+			} catch (std::exception &e) {
+				LOG(ERROR) << "Failed to import quotes: " << e.what();
+				return false;
+			}
+			return true;
+		});
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to import quotes: " << e.what();
+	}
+
+	if (!committed)
+		return {};
+
+	if (skipped > 0)
+		LOG(WARNING) << "Quote import: " << skipped << " malformed lines skipped";
+
+	return imported;
+}
+
+std::optional<std::string> Quotes::GetDumpPath(const std::string &fileName) const
+{
+	// Dumps are confined to the database directory
+	if (fileName.find('/') != fileName.npos
+			|| fileName.find("..") != fileName.npos)
+	{
+		LOG(WARNING) << "Rejected quote dump path: " << fileName;
+		return {};
+	}
+
+	return (_botPtr ? _botPtr->GetDBPathPrefix() : "db") + "/" + fileName;
 }
 
 #ifdef _BUILD_TESTS // LCOV_EXCL_START
@@ -184,6 +371,7 @@ public:
 	}
 
 	void SendMessage(const std::string &text);
+	std::string GetDBPathPrefix() const override { return "testdb"; }
 	std::vector<std::string> _received;
 };
 
@@ -248,4 +436,31 @@ TEST(QuotesTest, RegenIndex)
 	EXPECT_EQ("(2/2) testquote3", quote3);
 }
 
+TEST(QuotesTest, ImportExport)
+{
+	QuoteTestBot source;
+	Quotes q(&source);
+
+	ASSERT_TRUE(q.AddQuote("testquote1"));
+	ASSERT_TRUE(q.AddQuote("multiline\ntestquote2"));
+
+	auto exported = q.ExportQuotes("quotes_test.jsonl");
+	ASSERT_TRUE(exported.has_value());
+	EXPECT_EQ(2, *exported);
+	EXPECT_FALSE(q.ExportQuotes("../quotes_test.jsonl").has_value());
+
+	QuoteTestBot target;
+	Quotes q2(&target);
+
+	ASSERT_TRUE(q2.AddQuote("existing quote"));
+
+	auto imported = q2.ImportQuotes("quotes_test.jsonl");
+	ASSERT_TRUE(imported.has_value());
+	EXPECT_EQ(2, *imported);
+
+	EXPECT_EQ("(2/3) testquote1", q2.GetQuote("2"));
+	EXPECT_EQ("(3/3) multiline\ntestquote2", q2.GetQuote("3"));
+	EXPECT_FALSE(q2.ImportQuotes("non_existent.jsonl").has_value());
+}
+
 #endif // LCOV_EXCL_STOP
@@ -3,6 +3,7 @@
 #include "lemonhandler.h"
 
 #include <random>
+#include <optional>
 
 #ifdef _BUILD_TESTS
 #include <gtest/gtest_prod.h>
@@ -20,15 +21,21 @@ private:
 	bool AddQuote(const std::string &text);
 	bool DeleteQuote(int id);
 	std::string FindQuote(const std::string &request);
-	void RegenerateIndex();
+	int RegenerateIndex();
+
+	std::optional<int> ExportQuotes(const std::string &fileName);
+	std::optional<int> ImportQuotes(const std::string &fileName);
+	std::optional<std::string> GetDumpPath(const std::string &fileName) const;
 
 private:
 	std::mt19937_64 _generator;
 
 	static constexpr int maxMatches = 10;
+	static constexpr int importBatchSize = 200;
 #ifdef _BUILD_TESTS
 	FRIEND_TEST(QuotesTest, General);
 	FRIEND_TEST(QuotesTest, Search);
 	FRIEND_TEST(QuotesTest, RegenIndex);
+	FRIEND_TEST(QuotesTest, ImportExport);
 #endif
 };
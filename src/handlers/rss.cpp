@@ -2,11 +2,12 @@
 
 #include <chrono>
 
-#include <cpr/cpr.h>
 #include <pugixml.hpp>
 
 #include <glog/logging.h>
 
+#include "util/html_entities.h"
+#include "util/sqlite_cursor.h"
 #include "util/stringops.h"
 #include "util/thread_util.h"
 
@@ -116,16 +117,17 @@ void RSSWatcher::UnregisterFeed(int id)
 std::string RSSWatcher::ListRSSFeeds()
 {
 	std::string result = "Registered feeds: ";
-	for (const auto &feed : getStorage().get_all<DB::RssFeed, std::list<DB::RssFeed>>())
-	{
+	RowCursor<DB::RssFeed>(getStorage()).ForEach([&](const DB::RssFeed &feed) {
 		result.append("\n" + getStorage().dump(feed));
-	}
+		return true;
+	});
 
 	return result;
 }
 
 void RSSWatcher::UpdateFeeds()
 {
+	// Feed list is short and fetches are slow, so no statement stays open across them
 	for (auto &feed : getStorage().get_all<DB::RssFeed, std::list<DB::RssFeed>>())
 	{
 		const auto item = GetLatestItem(feed.URL);
@@ -150,14 +152,14 @@ std::optional<RSSItem> RSSWatcher::GetLatestItem(const std::string &feedURL) con
 
 std::optional<std::string> RSSWatcher::fetchRawRSS(const std::string &feedURL) const
 {
-	auto feedContent = cpr::Get(cpr::Url(feedURL), cpr::Timeout(2000));
-	if (feedContent.status_code != 200)
+	auto feedContent = getHttpClient().Get(feedURL, {}, std::chrono::milliseconds(2000));
+	if (feedContent._statusCode != 200)
 	{
-		LOG(WARNING) << "Status code is not 200 OK: " + std::to_string(feedContent.status_code) + " | " + feedContent.error.message;
+		LOG(WARNING) << "Status code is not 200 OK: " + std::to_string(feedContent._statusCode) + " | " + feedContent._error;
 		return {};
 	}
 
-	return feedContent.text;
+	return feedContent._body;
 }
 
 std::optional<RSSItem> RSSWatcher::parseRawRSS(const std::string &rawRSS) const
@@ -186,9 +188,10 @@ std::optional<RSSItem> RSSWatcher::parseRawRSS(const std::string &rawRSS) const
 
 std::string RSSItem::Format() const
 {
-	return title + " @ " + pubDate + \
+	// Feeds often escape markup twice, pugixml only undoes the XML level
+	return decodeHTMLEntities(title) + " @ " + pubDate + \
 			" ( " + link + " )" + \
-			"\n\n" + description;
+			"\n\n" + decodeHTMLEntities(description);
 }
 
 #ifdef _BUILD_TESTS // LCOV_EXCL_START
@@ -236,5 +239,11 @@ TEST(RSSReader, Parse)
 	}
 }
 
+TEST(RSSReader, FormatEntities)
+{
+	RSSItem item{ "Tom &amp; Jerry&nbsp;&#8470;1", "today", "http://example.com", "&lt;b&gt;bold&lt;/b&gt; &hellip;", "guid" };
+	EXPECT_EQ(u8"Tom & Jerry\u00a0№1 @ today ( http://example.com )\n\n<b>bold</b> …", item.Format());
+}
+
 #endif // LCOV_EXCL_STOP
 
@@ -1,18 +1,22 @@
 #include "urlpreview.h"
 
 #include <map>
+#include <algorithm>
+#include <optional>
 #include <regex>
 #include <chrono>
 
 #include <glog/logging.h>
 #include <boost/algorithm/string.hpp>
-#include <boost/locale/encoding.hpp>
-#include <boost/locale/encoding_utf.hpp>
-#include <cpr/cpr.h>
 
+#include "util/multifetch.h"
+#include "util/oembed.h"
+#include "util/html_entities.h"
+#include "util/sqlite_cursor.h"
+#include "util/html_head_scanner.h"
 #include "util/stringops.h"
-
-std::string formatHTMLchars(std::string input);
+#include "util/fetch_stats.h"
+#include "util/http_client.h"
 
 UrlPreview::UrlPreview(LemonBot *bot)
 	: LemonHandler("url", bot)
@@ -20,6 +24,48 @@ UrlPreview::UrlPreview(LemonBot *bot)
 
 }
 
+bool UrlPreview::Init()
+{
+	auto cacheSize = from_string<int>(GetRawConfigValue("URL.TitleCacheSize")).value_or(defaultTitleCacheSize);
+	auto cacheTTL = from_string<int>(GetRawConfigValue("URL.TitleCacheTTL")).value_or(defaultTitleCacheTTL);
+	auto cacheFailureTTL = from_string<int>(GetRawConfigValue("URL.TitleCacheFailureTTL")).value_or(defaultTitleCacheFailureTTL);
+	_titleCache = std::make_unique<TitleCache>(std::max(cacheSize, 1), std::chrono::seconds(cacheTTL), std::chrono::seconds(cacheFailureTTL));
+
+	// Catalog rows from before canonical keys get theirs first. Stored keys are never recomputed,
+	// so changed [canonical] rules only apply to URLs first posted after the change
+	auto keyed = getStorageWorker().Query([this](Storage &storage) { return fillCanonicalKeys(storage); }).get();
+	if (keyed > 0)
+		LOG(INFO) << keyed << " URLs in catalog got canonical keys";
+
+	warmTitleCache(std::max(cacheSize, 1));
+
+	auto repostWindow = from_string<int>(GetRawConfigValue("URL.RepostWindowMinutes")).value_or(defaultRepostWindowMinutes);
+	if (repostWindow > 0)
+	{
+		auto indexSize = from_string<int>(GetRawConfigValue("URL.RepostIndexSize")).value_or(defaultRepostIndexSize);
+		_recentLinks = std::make_unique<RecentLinks>(std::max(indexSize, 1), std::chrono::minutes(repostWindow));
+		seedRecentLinks(std::max(indexSize, 1));
+	}
+
+	_telemetryDays = from_string<int>(GetRawConfigValue("URL.TelemetryDays")).value_or(defaultTelemetryDays);
+	if (_telemetryDays > 0)
+		_telemetryTask = std::make_unique<PeriodicTask>("URL telemetry", std::chrono::hours(24), [this] { pruneTelemetry(); });
+
+	_retentionDays = from_string<int>(GetRawConfigValue("URL.RetentionDays")).value_or(0);
+	if (_retentionDays <= 0)
+		return true;
+
+	_retentionTask = std::make_unique<PeriodicTask>("URL retention", std::chrono::hours(retentionCheckHours), [this] {
+		auto archived = applyRetention();
+		if (archived > 0)
+			LOG(INFO) << archived << " URL postings moved to archive";
+		if (_isRetentionReported.exchange(false))
+			SendMessage(std::to_string(archived) + " URL postings moved to archive");
+	});
+
+	return true;
+}
+
 LemonHandler::ProcessingResult UrlPreview::HandleMessage(const ChatMessage &msg)
 {
 	std::string args;
@@ -36,6 +82,34 @@ LemonHandler::ProcessingResult UrlPreview::HandleMessage(const ChatMessage &msg)
 		return ProcessingResult::StopProcessing;
 	}
 
+	if (getCommandArguments(body, "!urlarchive", args))
+	{
+		SendMessage(concatenateArchivedURLs(findUrlsInArchive(args)));
+		return ProcessingResult::StopProcessing;
+	}
+
+	if (body == "!urlretention" && msg._isAdmin)
+	{
+		if (_retentionDays <= 0 || !_retentionTask)
+		{
+			SendMessage("URL retention is disabled (URL.RetentionDays)");
+			return ProcessingResult::StopProcessing;
+		}
+
+		// Archiving may take a while, it runs on the retention thread and reports from there
+		_isRetentionReported = true;
+		_retentionTask->Trigger();
+		SendMessage("URL retention started");
+		return ProcessingResult::StopProcessing;
+	}
+
+	if (getCommandArguments(body, "!fetchstats", args) && msg._isAdmin)
+	{
+		auto hours = from_string<int>(args).value_or(defaultFetchStatsHours);
+		SendMessage(formatFetchStats(std::max(hours, 1)));
+		return ProcessingResult::StopProcessing;
+	}
+
 	if (getCommandArguments(body, "!wlisturl", args))
 	{
 		addRuleToRuleset(args, false)
@@ -70,120 +144,264 @@ LemonHandler::ProcessingResult UrlPreview::HandleMessage(const ChatMessage &msg)
 		return ProcessingResult::KeepGoing;
 	}
 
-	auto sites = findURLs(body);
-	if (sites.empty())
+	auto found = findURLs(body);
+	if (found.empty())
 		return ProcessingResult::KeepGoing;
 
+	// Links to the same resource are fetched, announced and logged once
+	std::vector<URL> sites;
+	std::vector<std::string> keys;
+	for (const auto &site : found)
+	{
+		auto key = canonicalize(site._url);
+		if (std::find(keys.begin(), keys.end(), key) != keys.end())
+			continue;
+
+		sites.push_back(site);
+		keys.push_back(key);
+	}
+
+	// Recent reposts are answered from the index without fetching, unless configured to echo the title again
+	auto repostAnnounce = GetRawConfigValue("URL.RepostAnnounce");
+	std::vector<std::optional<RecentLinks::Posting>> reposts(sites.size());
+	if (_recentLinks && repostAnnounce != "title")
+	{
+		for (size_t i = 0; i < sites.size(); i++)
+			reposts[i] = _recentLinks->Find(keys[i]);
+	}
+
 	int urlsFound = 0;
-	for (auto &site : sites)
+	auto announce = [&](size_t site, const std::string &title, bool isLate) {
+		const auto &url = sites[site]._url;
+
+		LogURL(url, keys[site], title, msg._nick);
+		if (_recentLinks)
+			_recentLinks->Add(keys[site], msg._nick);
+
+		if (reposts[site] && repostAnnounce == "silent")
+			return;
+
+		// Late pages are only logged
+		if (!isLate && shouldPrintTitle(url) && urlsFound < maxURLsInOneMessage)
+			SendMessage(reposts[site] ? formatRepost(*reposts[site], decodeHTMLEntities(title)) : decodeHTMLEntities(title));
+
+		urlsFound++;
+	};
+
+	// Cached titles (and recent failures) are answered without fetching
+	std::vector<std::optional<TitleCache::Entry>> cached(sites.size());
+	std::vector<size_t> fetchedSites;
+	std::vector<std::optional<OEmbedProvider>> providers;
+	std::vector<FetchRequest> requests;
+	for (size_t i = 0; i < sites.size(); i++)
 	{
-		auto acceptLanguage = GetRawConfigValue("URL.AcceptLanguage");
-		auto page = cpr::Get(cpr::Url{site._url},
-							 cpr::Timeout{2000},
-							 cpr::Header{{"Accept-Language",
-										  acceptLanguage.empty() ? "ru,en" : acceptLanguage}});
-
-		std::string title = "";
-		if (page.status_code != 200)
+		if (_titleCache)
+			cached[i] = _titleCache->Get(keys[i]);
+
+		if (!cached[i] && !reposts[i])
 		{
-			LOG(INFO) << "URL: " << site._url << " | Status code: " << page.status_code
-					  << " | Error: " << page.error.message;
-		} else {
-			const auto &siteContent = page.text;
-			title = getTitle(siteContent);
+			fetchedSites.push_back(i);
+			providers.push_back(findOEmbedProvider(sites[i]));
+			requests.push_back(providers.back() ? makeOEmbedRequest(*providers.back(), sites[i]._url) : makePageRequest(sites[i]._url));
 		}
+	}
 
-		// FIXME: should we ever delete urls now?
-		auto now = std::chrono::system_clock::now();
-		DB::LoggedURL record = { -1, site._url, title,
-								 std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count(),
-							   site._url + " " + title};
-
-		getStorage().insert(record);
+	// Only the head of a page is downloaded, transfer stops once the title and its charset are known
+	std::vector<HTMLHeadScanner> scanners(requests.size());
+	std::vector<std::optional<std::string>> oembedTitles(requests.size());
+	std::vector<bool> isScraped(requests.size(), false);
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		if (!providers[i])
+		{
+			attachScanner(requests[i], scanners[i]);
+			continue;
+		}
 
-		if (shouldPrintTitle(site._url) && urlsFound < maxURLsInOneMessage)
-			SendMessage(formatHTMLchars(title));
+		// Provider didn't help, the page is scraped in the same run instead
+		requests[i]._onFinished = [&, i](const FetchResult &result) -> std::optional<FetchRequest> {
+			oembedTitles[i] = getOEmbedTitle(*providers[i], result);
+			if (oembedTitles[i])
+				return {};
 
-		urlsFound++;
+			recordFetch(result);
+			isScraped[i] = true;
+			auto request = makePageRequest(sites[fetchedSites[i]]._url);
+			attachScanner(request, scanners[i]);
+			return request;
+		};
 	}
 
+	size_t nextSite = 0;
+	auto announceCachedBefore = [&](size_t end) {
+		for (; nextSite < end; nextSite++)
+		{
+			// Reposts without a cached title are answered from the index alone, nothing to count
+			if (!cached[nextSite])
+			{
+				announce(nextSite, "", false);
+				continue;
+			}
+
+			recordCacheHit(sites[nextSite]._url);
+			announce(nextSite, cached[nextSite]->_title, false);
+		}
+	};
+
+	// All URLs of the message are fetched at once, titles still go out in message order
+	const auto budget = std::chrono::milliseconds(from_string<int>(GetRawConfigValue("URL.FetchBudgetMs")).value_or(defaultFetchBudgetMs));
+	MultiFetch(budget, &getHttpClient()).Run(requests, [&](size_t index, const FetchResult &result) {
+		announceCachedBefore(fetchedSites[index]);
+
+		recordFetch(result);
+
+		auto site = fetchedSites[index];
+		bool isLate = result._isLate;
+		std::optional<std::string> title;
+		if (!providers[index] || isScraped[index])
+			title = getPageTitle(result, scanners[index]);
+		else
+			title = oembedTitles[index];
+
+		if (_titleCache)
+		{
+			if (title)
+				_titleCache->Put(keys[site], *title);
+			else
+				_titleCache->PutFailure(keys[site]);
+		}
+
+		announce(site, title.value_or(""), isLate);
+		nextSite = site + 1;
+	});
+	announceCachedBefore(sites.size());
+
 	return ProcessingResult::KeepGoing;
 }
 
 const std::string UrlPreview::GetHelp() const
 {
 	return "!url %regex% - search in URL history by title or url\n"
+		   "!urlarchive [YYYY-MM] %text% - search archived URL history, optionally in one month only\n"
 		   "!wlisturl %regex% and !blisturl %regex% - enable/disable notifications for specific urls\n"
 		   "!wdelisturl %id% and !bdelisturl %id% - delete existing rules. !urlrules - print existing rules and their ids";
 }
 
 std::string UrlPreview::getTitle(const std::string &content) const
 {
-	// FIXME: maybe should use actual HTML parser here?
-	const std::string titleOp("<title>");
-	const std::string titleClose("</title>");
-	auto titleBegin = content.find(titleOp);
-	if (titleBegin == content.npos)
-		return "";
+	HTMLHeadScanner scanner;
+	scanner.Feed(content);
+	return getTitle(scanner, "");
+}
 
-	auto titleEnd = content.find(titleClose, titleBegin);
-	if (titleEnd == content.npos)
+std::string UrlPreview::getTitle(const HTMLHeadScanner &scanner, const std::string &contentType) const
+{
+	auto rawTitle = scanner.GetTitle();
+	if (!rawTitle)
 		return "";
 
-	auto title = content.substr(titleBegin + titleOp.size(), titleEnd - titleBegin - titleOp.size());
+	auto title = *rawTitle;
 	boost::trim(title);
 
 	if (title.length() > 200) {
 		return "Title is too long";
 	}
 
-	try {
-		return boost::locale::conv::utf_to_utf<char>(title.c_str(), boost::locale::conv::stop);
-	} catch (boost::locale::conv::conversion_error &e) {
-		LOG(INFO) << "Non-unicode header: " + std::string(e.what()) + "}";
-	}
+	// Byte order mark wins over the Content-Type header, which wins over <meta>
+	auto charset = scanner.HasBOM() ? scanner.GetCharset() : HTMLHeadScanner::GetContentTypeCharset(contentType);
+	if (charset.empty())
+		charset = scanner.GetCharset();
+	charset = CharsetConverter::NormalizeCharset(charset);
 
-	auto codepage = getMetaCodepage(content);
+	// Pages often declare Latin-1 while sending UTF-8, and such bytes are almost never real single-byte text
+	if (CharsetConverter::IsSingleByte(charset) && CharsetConverter::IsValidUTF8(title))
+		return title;
 
-	if (!codepage.empty()) {
-		try {
-			return boost::locale::conv::to_utf<char>(title.c_str(), codepage);
-		} catch (boost::locale::conv::conversion_error &e) {
-			LOG(INFO) << "Failed to convert from " + codepage + ": " + std::string(e.what()) + "}";
-		}
+	if (!charset.empty() && charset != "utf-8")
+	{
+		if (auto converted = CharsetConverter::ToUTF8(title, charset))
+			return *converted;
+		LOG(INFO) << "Failed to convert title from " << charset;
 	}
 
+	if (CharsetConverter::IsValidUTF8(title))
+		return title;
+
 	return "{ Unsupported code page in title }";
 }
 
-std::string UrlPreview::getMetaCodepage(const std::string &content) const
+FetchRequest UrlPreview::makePageRequest(const std::string &url) const
 {
-	// Hack to support some old Russian websites
-	const std::string metaOp = "meta charset=\"";
-	auto codepageBegin = content.find(metaOp);
-	if (codepageBegin == content.npos)
-		return "";
+	auto acceptLanguage = GetRawConfigValue("URL.AcceptLanguage");
+	auto maxBytes = from_string<int>(GetRawConfigValue("URL.MaxFetchBytes")).value_or(defaultMaxFetchBytes);
+	return { url, { "Accept-Language: " + (acceptLanguage.empty() ? "ru,en" : acceptLanguage) },
+			 { "text/html", "application/xhtml+xml" }, static_cast<size_t>(std::max(maxBytes, 1)) };
+}
 
-	auto codepageEnd = content.find("\"", codepageBegin + metaOp.size());
-	if (codepageEnd == content.npos)
-		return "";
+void UrlPreview::attachScanner(FetchRequest &request, HTMLHeadScanner &scanner)
+{
+	request._onData = [&scanner](const char *data, size_t size) {
+		return scanner.Feed(data, size);
+	};
+}
 
-	auto codepage = content.substr(codepageBegin + metaOp.size(), codepageEnd - codepageBegin - metaOp.size());
-	boost::trim(codepage);
+std::optional<std::string> UrlPreview::getPageTitle(const FetchResult &page, const HTMLHeadScanner &scanner) const
+{
+	if (page._statusCode != 200 || !page._error.empty())
+	{
+		LOG(INFO) << "URL: " << page._url << " | Status code: " << page._statusCode
+				  << " | Error: " << page._error << " | " << page._elapsed.count() << " ms";
+		return {};
+	}
+
+	return getTitle(scanner, page._contentType);
+}
+
+std::optional<OEmbedProvider> UrlPreview::findOEmbedProvider(const URL &site) const
+{
+	// [oembed] config table maps extra hostnames to endpoints
+	auto endpoint = GetRawConfigValue("oembed", site._hostname);
+	std::optional<OEmbedProvider> provider;
+	if (!endpoint.empty())
+		provider = OEmbedProvider(site._hostname, { site._hostname }, endpoint);
+	else if (auto builtin = _oembedProviders.Find(site._hostname))
+		provider = *builtin;
+
+	if (!provider || !provider->GetRequestURL(site._url))
+		return {};
+
+	return provider;
+}
+
+FetchRequest UrlPreview::makeOEmbedRequest(const OEmbedProvider &provider, const std::string &url) const
+{
+	return { provider.GetRequestURL(url).value_or(""), provider._headers,
+			 { "application/json", "text/javascript", "application/javascript" }, maxOEmbedBytes };
+}
+
+std::optional<std::string> UrlPreview::getOEmbedTitle(const OEmbedProvider &provider, const FetchResult &result) const
+{
+	if (result._statusCode != 200 || !result._error.empty() || result._isTruncated)
+	{
+		LOG(INFO) << provider._name << " endpoint: " << result._url << " | Status code: " << result._statusCode
+				  << " | Error: " << result._error << " | " << result._elapsed.count() << " ms";
+		return {};
+	}
 
-	return codepage;
+	return provider.ParseTitle(result._body);
 }
 
-std::vector<DB::LoggedURL> UrlPreview::findUrlsInHistory(const std::string &request)
+std::vector<DB::CatalogURL> UrlPreview::findUrlsInHistory(const std::string &request)
 {
 	using namespace sqlite_orm;
-	return getStorage().get_all<DB::LoggedURL>(
-				where(like(&DB::LoggedURL::fullText, "%" + request + "%")),
-				order_by(&DB::LoggedURL::id).desc(),
+	return getStorage().get_all<DB::CatalogURL>(
+				where(like(&DB::CatalogURL::fullText, "%" + request + "%")),
+				multi_order_by(order_by(&DB::CatalogURL::lastSeen).desc(),
+							   order_by(&DB::CatalogURL::id).desc()),
 				limit(maxURLsInSearch));
 }
 
-std::string UrlPreview::concatenateURLs(const std::vector<DB::LoggedURL> &urls, bool withIndices) const
+std::string UrlPreview::concatenateURLs(const std::vector<DB::CatalogURL> &urls, bool withIndices) const
 {
 	if (urls.empty())
 		return "No matches";
@@ -192,32 +410,439 @@ std::string UrlPreview::concatenateURLs(const std::vector<DB::LoggedURL> &urls,
 	searchResults = std::to_string(maxURLsInSearch) + " recent matching URLs: \n";
 	for (const auto &url : urls)
 	{
-		searchResults += withIndices
-				? (std::to_string(url.id) + ") " + url.URL + " " + url.title + "\n")
-				: (url.URL + " " + url.title + "\n");
+		if (withIndices)
+			searchResults += std::to_string(url.id) + ") ";
+
+		searchResults += url.URL + " " + url.title;
+
+		if (url.postCount > 1)
+			searchResults += " [posted " + std::to_string(url.postCount) + " times]";
+
+		searchResults += "\n";
 	}
 
 	return searchResults;
 }
 
-bool UrlPreview::shouldPrintTitle(const std::string &url) // FIXME const
+void UrlPreview::LogURL(const std::string &url, const std::string &key, const std::string &title, const std::string &poster)
+{
+	using namespace sqlite_orm;
+	auto now = std::chrono::duration_cast<std::chrono::seconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+
+	// One catalog row per canonical URL, every posting only adds a small occurrence row.
+	// Job is committed by the storage worker together with its neighbours
+	getStorageWorker().Mutate([url, key, title, poster, now](Storage &storage) {
+		// URL match catches rows keyed before host rules changed
+		auto existing = storage.get_all<DB::CatalogURL>(
+					where(is_equal(&DB::CatalogURL::canonical, key) || is_equal(&DB::CatalogURL::URL, url)), limit(1));
+
+		int urlID = -1;
+		if (existing.empty())
+		{
+			DB::CatalogURL entry = { -1, url, title, url + " " + title, now, now, 1, key };
+			urlID = storage.insert(entry);
+		} else {
+			auto &entry = existing.front();
+			if (!title.empty())
+			{
+				entry.title = title;
+				entry.fullText = entry.URL + " " + title;
+			}
+			entry.canonical = key;
+			entry.lastSeen = now;
+			++entry.postCount;
+			storage.update(entry);
+			urlID = entry.id;
+		}
+
+		DB::URLOccurrence occurrence = { -1, urlID, now, poster };
+		storage.insert(occurrence);
+	});
+}
+
+void UrlPreview::warmTitleCache(int maxEntries)
+{
+	using namespace sqlite_orm;
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto horizon = now - _titleCache->GetTTL().count();
+
+	try {
+		// Last posting time stands in for fetch time. Oldest go first,
+		// so the most recent links end up at the top of the LRU list
+		auto recent = getStorage().get_all<DB::CatalogURL>(
+					where(greater_or_equal(&DB::CatalogURL::lastSeen, horizon)
+						  && is_not_equal(&DB::CatalogURL::title, "")),
+					order_by(&DB::CatalogURL::lastSeen).desc(),
+					limit(maxEntries));
+
+		for (auto url = recent.rbegin(); url != recent.rend(); ++url)
+			_titleCache->Put(url->canonical, url->title, std::chrono::system_clock::from_time_t(url->lastSeen));
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to warm up title cache: " << e.what();
+	}
+
+	LOG(INFO) << "Title cache warmed up with " << _titleCache->Size() << " URLs";
+}
+
+std::string UrlPreview::canonicalize(const std::string &url) const
 {
-	bool blacklisted = false;
-	bool whitelisted = false;
+	// [canonical] config table holds extra host rules, e.g. example.com="keep=id; drop=ref"
+	auto configured = URLHostRule::Parse(GetRawConfigValue("canonical", URLCanonicalizer::GetHost(url)));
+	return _canonicalizer.Canonicalize(url, configured ? &*configured : nullptr);
+}
+
+int UrlPreview::fillCanonicalKeys(Storage &storage)
+{
+	using namespace sqlite_orm;
+	int filled = 0;
+	int lastID = -1;
+
+	try {
+		while (true)
+		{
+			auto pending = storage.get_all<DB::CatalogURL>(
+						where(is_equal(&DB::CatalogURL::canonical, "") && greater_than(&DB::CatalogURL::id, lastID)),
+						order_by(&DB::CatalogURL::id),
+						limit(retentionBatchSize));
+
+			if (pending.empty())
+				break;
+
+			bool committed = storage.transaction([&] {
+				try {
+					for (auto &entry : pending)
+					{
+						entry.canonical = canonicalize(entry.URL);
+						auto existing = storage.get_all<DB::CatalogURL>(
+									where(is_equal(&DB::CatalogURL::canonical, entry.canonical)), limit(1));
+
+						if (existing.empty())
+						{
+							storage.update(entry);
+							continue;
+						}
+
+						// Earlier row with the same key takes over postings of this one
+						auto &target = existing.front();
+						if (!entry.title.empty() && (target.title.empty() || entry.lastSeen > target.lastSeen))
+						{
+							target.title = entry.title;
+							target.fullText = target.URL + " " + entry.title;
+						}
+						target.firstSeen = std::min(target.firstSeen, entry.firstSeen);
+						target.lastSeen = std::max(target.lastSeen, entry.lastSeen);
+						target.postCount += entry.postCount;
+						storage.update(target);
+						storage.update_all(set(c(&DB::URLOccurrence::urlID) = target.id),
+												where(is_equal(&DB::URLOccurrence::urlID, entry.id)));
+						storage.remove<DB::CatalogURL>(entry.id);
+					}
+				} catch (std::exception &e) {
+					LOG(ERROR) << "Failed to fill canonical URL keys: " << e.what();
+					return false;
+				}
+				return true;
+			});
+
+			if (!committed)
+				break;
+
+			filled += static_cast<int>(pending.size());
+			lastID = pending.back().id;
+		}
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Canonical URL key backfill failed: " << e.what();
+	}
+
+	return filled;
+}
+
+void UrlPreview::seedRecentLinks(int maxEntries)
+{
+	using namespace sqlite_orm;
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto horizon = now - _recentLinks->GetWindow().count();
+
+	try {
+		auto occurrences = getStorage().get_all<DB::URLOccurrence>(
+					where(greater_or_equal(&DB::URLOccurrence::timestamp, horizon)),
+					order_by(&DB::URLOccurrence::timestamp).desc(),
+					limit(maxEntries));
+
+		// Oldest go first, so every link keeps its first posting in the window
+		std::map<int, std::string> keys;
+		for (auto occurrence = occurrences.rbegin(); occurrence != occurrences.rend(); ++occurrence)
+		{
+			auto key = keys.find(occurrence->urlID);
+			if (key == keys.end())
+			{
+				auto url = getStorage().get_no_throw<DB::CatalogURL>(occurrence->urlID);
+				if (!url)
+					continue;
+				key = keys.emplace(occurrence->urlID, url->canonical.empty() ? canonicalize(url->URL) : url->canonical).first;
+			}
+
+			_recentLinks->Add(key->second, occurrence->poster, std::chrono::system_clock::from_time_t(occurrence->timestamp));
+		}
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to seed recent links: " << e.what();
+	}
+
+	LOG(INFO) << "Recent links index seeded with " << _recentLinks->Size() << " URLs";
+}
+
+std::string UrlPreview::formatRepost(const RecentLinks::Posting &posting, const std::string &title)
+{
+	auto age = RecentLinks::FormatAge(RecentLinks::Clock::now() - posting._postedAt);
+	if (title.empty())
+		return "Posted by " + posting._poster + " " + age + " ago";
+
+	return title + " [posted by " + posting._poster + " " + age + " ago]";
+}
+
+void UrlPreview::recordFetch(const FetchResult &result)
+{
+	if (_telemetryDays <= 0)
+		return;
+
+	auto milliseconds = [](std::chrono::microseconds time) {
+		return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(time).count());
+	};
 
-	for (const auto &rule : getStorage().get_all<DB::URLRule>())
+	DB::URLFetch fetch;
+	fetch.timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	fetch.host = HttpClient::GetHost(result._url);
+	fetch.status = static_cast<int>(result._statusCode);
+	fetch.failed = result._statusCode != 200 || !result._error.empty();
+	fetch.dnsMs = milliseconds(result._dnsTime);
+	fetch.connectMs = milliseconds(result._connectTime);
+	fetch.tlsMs = milliseconds(result._tlsTime);
+	fetch.firstByteMs = milliseconds(result._firstByteTime);
+	// Late fetches were aborted before curl finished timing them
+	fetch.totalMs = result._isLate ? static_cast<int>(result._elapsed.count()) : milliseconds(result._totalTime);
+	fetch.bytes = static_cast<long>(result._bytesReceived);
+	fetch.contentType = result._contentType.substr(0, result._contentType.find(';'));
+	fetch.httpVersion = result._httpVersion;
+
+	getStorageWorker().Mutate([fetch](Storage &storage) { storage.insert(fetch); });
+}
+
+void UrlPreview::recordCacheHit(const std::string &url)
+{
+	if (_telemetryDays <= 0)
+		return;
+
+	DB::URLFetch fetch;
+	fetch.timestamp = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	fetch.host = HttpClient::GetHost(url);
+	fetch.cacheHit = true;
+
+	getStorageWorker().Mutate([fetch](Storage &storage) { storage.insert(fetch); });
+}
+
+void UrlPreview::pruneTelemetry()
+{
+	using namespace sqlite_orm;
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto horizon = now - std::chrono::seconds(std::chrono::hours(24) * _telemetryDays).count();
+
+	getStorageWorker().Mutate([horizon](Storage &storage) {
+		storage.remove_all<DB::URLFetch>(where(lesser_than(&DB::URLFetch::timestamp, horizon)));
+	});
+}
+
+std::string UrlPreview::formatFetchStats(int hours)
+{
+	using namespace sqlite_orm;
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto since = now - std::chrono::seconds(std::chrono::hours(hours)).count();
+
+	// Query sees telemetry rows still queued in the worker
+	FetchStats stats;
+	try {
+		getStorageWorker().Query([&stats, since](Storage &storage) {
+			for (const auto &fetch : storage.get_all<DB::URLFetch>(where(greater_or_equal(&DB::URLFetch::timestamp, since))))
+				stats.Add(fetch);
+		}).get();
+	} catch (std::exception &e) {
+		LOG(ERROR) << "Failed to read URL fetch telemetry: " << e.what();
+		return "Failed to read URL fetch telemetry";
+	}
+
+	return "Last " + std::to_string(hours) + "h. " + stats.Format(maxHostsInFetchStats);
+}
+
+int UrlPreview::applyRetention()
+{
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto horizon = now - std::chrono::seconds(std::chrono::hours(24) * _retentionDays).count();
+
+	// Runs on the storage thread, so no URL logging happens in between
+	return getStorageWorker().Query([this, horizon](Storage &storage) { return ArchiveOlderThan(storage, horizon); }).get();
+}
+
+int UrlPreview::ArchiveOlderThan(Storage &storage, long horizon)
+{
+	using namespace sqlite_orm;
+	std::lock_guard<std::mutex> lock(_historyMutex);
+
+	auto archive = getArchive();
+	int archived = 0;
+	bool complete = false;
+
+	try {
+		while (true)
+		{
+			auto occurrences = storage.get_all<DB::URLOccurrence>(
+						where(lesser_than(&DB::URLOccurrence::timestamp, horizon)),
+						order_by(&DB::URLOccurrence::timestamp),
+						limit(retentionBatchSize));
+
+			if (occurrences.empty())
+			{
+				complete = true;
+				break;
+			}
+
+			std::map<int, DB::CatalogURL> catalog;
+			std::vector<ArchivedURL> records;
+			std::vector<int> ids;
+			for (const auto &occurrence : occurrences)
+			{
+				auto entry = catalog.find(occurrence.urlID);
+				if (entry == catalog.end())
+				{
+					auto url = storage.get_no_throw<DB::CatalogURL>(occurrence.urlID);
+					entry = catalog.emplace(occurrence.urlID, url ? *url : DB::CatalogURL{}).first;
+				}
+
+				records.push_back({ entry->second.URL, entry->second.title, occurrence.timestamp, occurrence.poster });
+				ids.push_back(occurrence.id);
+			}
+
+			// Segment is written first, rows are only deleted once their block is indexed
+			auto blocks = archive.Append(records);
+			if (!blocks)
+				break;
+
+			bool committed = storage.transaction([&] {
+				try {
+					for (const auto &block : *blocks)
+						storage.insert(block);
+					storage.remove_all<DB::URLOccurrence>(where(in(&DB::URLOccurrence::id, ids)));
+				} catch (std::exception &e) {
+					LOG(ERROR) << "Failed to move URL postings to archive: " << e.what();
+					return false;
+				}
+				return true;
+			});
+
+			if (!committed)
+				break;
+
+			archived += static_cast<int>(occurrences.size());
+		}
+
+		// URLs not posted since horizon are only kept in the archive
+		if (complete)
+			storage.remove_all<DB::CatalogURL>(where(lesser_than(&DB::CatalogURL::lastSeen, horizon)));
+	} catch (std::exception &e) {
+		LOG(ERROR) << "URL retention failed: " << e.what();
+	}
+
+	return archived;
+}
+
+std::vector<ArchivedURL> UrlPreview::findUrlsInArchive(const std::string &request)
+{
+	using namespace sqlite_orm;
+
+	// Optional month prefix narrows search down to blocks of one segment
+	std::string month;
+	std::string text = request;
+	static const std::regex monthPrefix("^(\\d{4}-\\d{2})(?: (.*))?$");
+	std::smatch match;
+	if (std::regex_match(request, match, monthPrefix))
 	{
-		std::smatch regexMatch;
-		auto searchRegex = std::regex(toLower(rule.rule));
-		auto doesMatch = std::regex_search(url, regexMatch, searchRegex);
+		month = match.str(1);
+		text = match.str(2);
+	}
+
+	std::vector<ArchivedURL> result;
+	try {
+		auto blocks = month.empty()
+				? getStorage().get_all<DB::URLArchiveBlock>(order_by(&DB::URLArchiveBlock::firstTime).desc())
+				: getStorage().get_all<DB::URLArchiveBlock>(where(is_equal(&DB::URLArchiveBlock::month, month)),
+															order_by(&DB::URLArchiveBlock::firstTime).desc());
+
+		auto archive = getArchive();
+		auto needle = toLower(text);
+		for (const auto &block : blocks)
+		{
+			auto records = archive.ReadBlock(block);
+			if (!records)
+				continue;
 
-		if (doesMatch) {
-			LOG(INFO) << "URL is found in rule: " << getStorage().dump(rule);
-			rule.blacklist ? blacklisted = true : whitelisted = true;
+			for (auto record = records->rbegin(); record != records->rend(); ++record)
+			{
+				if (toLower(record->_url + " " + record->_title).find(needle) == std::string::npos)
+					continue;
+
+				result.push_back(*record);
+				if (result.size() >= maxURLsInSearch)
+					return result;
+			}
 		}
+	} catch (std::exception &e) {
+		LOG(ERROR) << "URL archive search failed: " << e.what();
 	}
 
-	return !blacklisted || whitelisted;
+	return result;
+}
+
+std::string UrlPreview::concatenateArchivedURLs(const std::vector<ArchivedURL> &urls) const
+{
+	if (urls.empty())
+		return "No matches in archive";
+
+	std::string searchResults = "Archived matching URLs: \n";
+	for (const auto &url : urls)
+		searchResults += URLArchive::MonthOf(url._timestamp) + " " + url._url + " " + url._title + "\n";
+
+	return searchResults;
+}
+
+URLArchive UrlPreview::getArchive() const
+{
+	return URLArchive((_botPtr ? _botPtr->GetDBPathPrefix() : "db") + "/url_archive_");
+}
+
+bool UrlPreview::shouldPrintTitle(const std::string &url)
+{
+	return getRuleSet()->ShouldPrint(url);
+}
+
+std::shared_ptr<const URLRuleSet> UrlPreview::getRuleSet()
+{
+	std::lock_guard<std::mutex> lock(_ruleSetMutex);
+	if (_ruleSet)
+		return _ruleSet;
+
+	auto ruleSet = std::make_shared<URLRuleSet>();
+	RowCursor<DB::URLRule>(getStorage()).ForEach([&](const DB::URLRule &rule) {
+		ruleSet->Add(rule.id, toLower(rule.rule), rule.blacklist);
+		return true;
+	});
+
+	_ruleSet = ruleSet;
+	return _ruleSet;
+}
+
+void UrlPreview::invalidateRuleSet()
+{
+	std::lock_guard<std::mutex> lock(_ruleSetMutex);
+	_ruleSet.reset();
 }
 
 bool UrlPreview::addRuleToRuleset(const std::string &rule, bool blacklist)
@@ -225,6 +850,7 @@ bool UrlPreview::addRuleToRuleset(const std::string &rule, bool blacklist)
 	DB::URLRule newRule = { -1, rule, blacklist };
 	try {
 		getStorage().insert(newRule);
+		invalidateRuleSet();
 		return true;
 	} catch (std::exception &e) {
 		LOG(ERROR) << "Failed to add rule: " << e.what();
@@ -236,6 +862,7 @@ bool UrlPreview::delRuleFromRuleset(int ruleID)
 {
 	try {
 		getStorage().remove<DB::URLRule>(ruleID);
+		invalidateRuleSet();
 		return true;
 	} catch (std::exception &e) {
 		LOG(ERROR) << "Failed to delete rule: " << e.what();
@@ -246,45 +873,20 @@ bool UrlPreview::delRuleFromRuleset(int ruleID)
 std::string UrlPreview::ShowURLRules()
 {
 	std::string result = "URL rules:";
-	for (auto &rule : getStorage().get_all<DB::URLRule>())
+	RowCursor<DB::URLRule>(getStorage()).ForEach([&](const DB::URLRule &rule) {
 		result.append("\n" + getStorage().dump(rule));
+		return true;
+	});
 
 	return result;
 }
 
-std::string formatHTMLchars(std::string input)
-{
-	std::map<std::string, std::string> chars
-			= {{"&quot;", "\""},
-			   {"&amp;", "&"},
-			   {"&lt;", "<"},
-			   {"&gt;", ">"},
-			   {"&apos;", "'"},
-			   {"&#39;", "'"},
-			   {"&bull;", "•"},
-			   {"&mdash;", "—"},
-			   {"&ndash;", "–"},
-			  };
-
-	for (auto &specialCharPair : chars)
-	{
-		auto &coded = specialCharPair.first;
-		auto &decoded = specialCharPair.second;
-		size_t pos = input.find(coded);
-		while (pos != input.npos)
-		{
-			input.replace(pos, coded.length(), decoded);
-			pos = input.find(coded);
-		}
-	}
-
-	return input;
-}
-
 #ifdef _BUILD_TESTS // LCOV_EXCL_START
 
 #include <gtest/gtest.h>
 #include <fstream>
+#include <cstdio>
+#include <limits>
 
 class UrlPreviewTestBot : public LemonBot
 {
@@ -294,6 +896,7 @@ public:
 	}
 
 	void SendMessage(const std::string &text);
+	std::string GetDBPathPrefix() const override { return "testdb"; }
 	std::string _lastMessage;
 };
 
@@ -305,7 +908,7 @@ void UrlPreviewTestBot::SendMessage(const std::string &text)
 TEST(URLPreview, HTMLSpecialChars)
 {
 	std::string input = "&quot;&amp;&gt;&lt;";
-	EXPECT_EQ("\"&><", formatHTMLchars(input));
+	EXPECT_EQ("\"&><", decodeHTMLEntities(input));
 }
 
 TEST(URLPreview, GetTitle)
@@ -318,7 +921,24 @@ TEST(URLPreview, GetTitle)
 						"<body><p>Test</p></body>"
 						"</html>\n");
 	std::string title = testUnit.getTitle(content);
-	EXPECT_EQ("This is a test title", formatHTMLchars(title));
+	EXPECT_EQ("This is a test title", decodeHTMLEntities(title));
+
+	EXPECT_EQ("Upper case", testUnit.getTitle("<HTML><HEAD><TITLE>Upper case</TITLE>"));
+	EXPECT_EQ("", testUnit.getTitle("<html><head><title>Never closed"));
+
+	HTMLHeadScanner cp1251;
+	cp1251.Feed("<head><meta http-equiv=Content-Type content=\"text/html; charset=windows-1251\"><title>\xcf\xf0\xe8\xe2\xe5\xf2</title>");
+	EXPECT_EQ(u8"Привет", testUnit.getTitle(cp1251, ""));
+	EXPECT_EQ(u8"Привет", testUnit.getTitle(cp1251, "text/html; charset=cp1251"));
+	EXPECT_EQ("{ Unsupported code page in title }", testUnit.getTitle(cp1251, "text/html; charset=utf-8"));
+
+	// Mislabeled UTF-8 is kept, real Latin-1 is still converted
+	HTMLHeadScanner latin1;
+	latin1.Feed(u8"<head><title>Café</title>");
+	EXPECT_EQ(u8"Café", testUnit.getTitle(latin1, "text/html; charset=ISO-8859-1"));
+	HTMLHeadScanner cafe;
+	cafe.Feed("<head><title>Caf\xe9</title>");
+	EXPECT_EQ(u8"Café", testUnit.getTitle(cafe, "text/html; charset=ISO-8859-1"));
 }
 
 TEST(URLPreview, History)
@@ -340,6 +960,179 @@ TEST(URLPreview, History)
 	for (const auto &record : history) {
 		EXPECT_EQ(record.URL, *expectedRecord++);
 	}
+
+	t.HandleMessage(ChatMessage("Alice", "", "", "http://test.ru/", false));
+
+	history = t.findUrlsInHistory("test.ru");
+	ASSERT_EQ(1, history.size());
+	EXPECT_EQ(2, history.front().postCount);
+	EXPECT_EQ(4, testBot._storage.count<DB::URLOccurrence>());
+}
+
+TEST(URLPreview, Rules)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+
+	EXPECT_TRUE(t.shouldPrintTitle("http://example.com/page"));
+
+	ASSERT_TRUE(t.addRuleToRuleset("Example.com", true));
+	EXPECT_FALSE(t.shouldPrintTitle("http://example.com/page"));
+	auto cached = t.getRuleSet();
+	EXPECT_EQ(cached, t.getRuleSet());
+
+	ASSERT_TRUE(t.addRuleToRuleset("example\\.com/p[a-z]+e", false));
+	EXPECT_NE(cached, t.getRuleSet());
+	EXPECT_TRUE(t.shouldPrintTitle("http://example.com/page"));
+	EXPECT_FALSE(t.shouldPrintTitle("http://example.com/other"));
+
+	auto rules = testBot._storage.get_all<DB::URLRule>();
+	ASSERT_EQ(2, rules.size());
+	ASSERT_TRUE(t.delRuleFromRuleset(rules.front().id));
+	EXPECT_TRUE(t.shouldPrintTitle("http://example.com/other"));
+}
+
+TEST(URLPreview, OEmbedProviders)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+
+	EXPECT_FALSE(t.findOEmbedProvider(URL("http://example.com/page", "example.com")).has_value());
+	EXPECT_FALSE(t.findOEmbedProvider(URL("https://github.com/a/b/issues", "github.com")).has_value());
+
+	auto youtube = t.findOEmbedProvider(URL("https://www.youtube.com/watch?v=abcde", "youtube.com"));
+	ASSERT_TRUE(youtube.has_value());
+
+	auto request = t.makeOEmbedRequest(*youtube, "https://www.youtube.com/watch?v=abcde");
+	EXPECT_EQ("https://www.youtube.com/oembed?format=json&url=https%3A%2F%2Fwww.youtube.com%2Fwatch%3Fv%3Dabcde", request._url);
+	EXPECT_FALSE(request._onData);
+
+	FetchResult result;
+	result._statusCode = 200;
+	result._body = "{\"title\": \"Video\"}";
+	EXPECT_EQ("Video", t.getOEmbedTitle(*youtube, result).value_or(""));
+
+	result._statusCode = 404;
+	EXPECT_FALSE(t.getOEmbedTitle(*youtube, result).has_value());
+}
+
+TEST(URLPreview, CanonicalKeys)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+
+	DB::CatalogURL shortURL = { -1, "https://youtu.be/abc", "Video", "", 100, 300, 1 };
+	auto shortID = testBot._storage.insert(shortURL);
+	testBot._storage.insert(DB::URLOccurrence{ -1, shortID, 300, "Bob" });
+
+	DB::CatalogURL longURL = { -1, "https://www.youtube.com/watch?v=abc&feature=share", "", "", 50, 200, 2 };
+	auto longID = testBot._storage.insert(longURL);
+	testBot._storage.insert(DB::URLOccurrence{ -1, longID, 50, "Alice" });
+	testBot._storage.insert(DB::URLOccurrence{ -1, longID, 200, "Alice" });
+
+	testBot._storage.insert(DB::CatalogURL{ -1, "http://example.com/?utm_source=x", "Example", "", 10, 10, 1 });
+
+	EXPECT_EQ(3, t.fillCanonicalKeys(testBot._storage));
+	EXPECT_EQ(0, t.fillCanonicalKeys(testBot._storage));
+	ASSERT_EQ(2, testBot._storage.count<DB::CatalogURL>());
+
+	auto merged = testBot._storage.get<DB::CatalogURL>(shortID);
+	EXPECT_EQ("https://youtube.com/watch?v=abc", merged.canonical);
+	EXPECT_EQ("Video", merged.title);
+	EXPECT_EQ(50, merged.firstSeen);
+	EXPECT_EQ(300, merged.lastSeen);
+	EXPECT_EQ(3, merged.postCount);
+
+	using namespace sqlite_orm;
+	EXPECT_EQ(3, testBot._storage.count<DB::URLOccurrence>(where(is_equal(&DB::URLOccurrence::urlID, shortID))));
+	EXPECT_EQ("http://example.com", t.canonicalize("http://www.example.com/?fbclid=1"));
+}
+
+TEST(URLPreview, Reposts)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+
+	auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+	auto urlID = testBot._storage.insert(DB::CatalogURL{ -1, "http://example.com/page", "Page", "", now - 720, now - 720, 1, "http://example.com/page" });
+	testBot._storage.insert(DB::URLOccurrence{ -1, urlID, now - 720, "Bob" });
+	auto oldID = testBot._storage.insert(DB::CatalogURL{ -1, "http://example.com/old", "Old", "", 100, 100, 1, "http://example.com/old" });
+	testBot._storage.insert(DB::URLOccurrence{ -1, oldID, 100, "Bob" });
+
+	t._recentLinks = std::make_unique<RecentLinks>(10, std::chrono::hours(1));
+	t.seedRecentLinks(10);
+	ASSERT_EQ(1, t._recentLinks->Size());
+
+	// Answered from the index, no fetch and no cache hit
+	t._telemetryDays = 1;
+	t.HandleMessage(ChatMessage("Alice", "", "", "look http://www.example.com/page/?utm_source=x", false));
+	EXPECT_EQ("Posted by Bob 12m ago", testBot._lastMessage);
+	EXPECT_EQ(0, testBot._storage.count<DB::URLFetch>());
+
+	EXPECT_EQ("Page [posted by Bob 12m ago]", t.formatRepost(*t._recentLinks->Find("http://example.com/page"), "Page"));
+}
+
+TEST(URLPreview, FetchTelemetry)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+	t._telemetryDays = 1;
+
+	FetchResult result;
+	result._url = "https://www.example.com/page";
+	result._statusCode = 200;
+	result._contentType = "text/html; charset=utf-8";
+	result._bytesReceived = 2048;
+	result._dnsTime = std::chrono::milliseconds(5);
+	result._firstByteTime = std::chrono::milliseconds(120);
+	result._totalTime = std::chrono::milliseconds(150);
+	result._httpVersion = "2";
+	t.recordFetch(result);
+	t.recordCacheHit("https://www.example.com/page");
+
+	auto stats = t.formatFetchStats(24);
+	EXPECT_EQ("Last 24h. URL fetches: 1, cache hits: 1, failed: 0, received 2.0 KiB\n"
+			  "www.example.com: 1 fetches, 150 ms total, avg 150 ms (dns 5, connect 0, tls 0, first byte 120), p95 150 ms, HTTP/2", stats);
+
+	// Huge windows from admin input cover everything instead of overflowing
+	stats = t.formatFetchStats(std::numeric_limits<int>::max());
+	EXPECT_NE(stats.npos, stats.find("URL fetches: 1, cache hits: 1"));
+
+	auto fetches = testBot._storage.get_all<DB::URLFetch>();
+	ASSERT_EQ(2, fetches.size());
+	EXPECT_EQ("text/html", fetches.front().contentType);
+	EXPECT_TRUE(fetches.back().cacheHit);
+}
+
+TEST(URLPreview, Retention)
+{
+	UrlPreviewTestBot testBot;
+	UrlPreview t(&testBot);
+
+	std::remove("testdb/url_archive_1970-01.seg");
+
+	DB::CatalogURL oldURL = { -1, "http://old.example.com/", "Old title", "", 100, 200, 2 };
+	auto oldID = testBot._storage.insert(oldURL);
+	testBot._storage.insert(DB::URLOccurrence{ -1, oldID, 100, "Bob" });
+	testBot._storage.insert(DB::URLOccurrence{ -1, oldID, 200, "Alice" });
+
+	DB::CatalogURL recentURL = { -1, "http://new.example.com/", "New title", "", 150, 5000, 2 };
+	auto recentID = testBot._storage.insert(recentURL);
+	testBot._storage.insert(DB::URLOccurrence{ -1, recentID, 150, "Bob" });
+	testBot._storage.insert(DB::URLOccurrence{ -1, recentID, 5000, "Bob" });
+
+	EXPECT_EQ(3, t.ArchiveOlderThan(testBot._storage, 1000));
+	EXPECT_EQ(1, testBot._storage.count<DB::URLOccurrence>());
+	EXPECT_EQ(1, testBot._storage.count<DB::CatalogURL>());
+
+	auto archived = t.findUrlsInArchive("old title");
+	ASSERT_EQ(2, archived.size());
+	EXPECT_EQ("Alice", archived.front()._poster);
+	EXPECT_EQ("http://old.example.com/", archived.front()._url);
+
+	EXPECT_EQ(3, t.findUrlsInArchive("1970-01 example").size());
+	EXPECT_TRUE(t.findUrlsInArchive("1970-02 example").empty());
+	EXPECT_EQ(0, t.ArchiveOlderThan(testBot._storage, 1000));
 }
 
 #endif // LCOV_EXCL_STOP
@@ -1,6 +1,20 @@
 #pragma once
 
 #include "lemonhandler.h"
+#include "util/url_archive.h"
+#include "util/periodic_task.h"
+#include "util/title_cache.h"
+#include "util/html_head_scanner.h"
+#include "util/url_ruleset.h"
+#include "util/multifetch.h"
+#include "util/oembed.h"
+#include "util/url_canonicalizer.h"
+#include "util/recent_links.h"
+#include "util/stringops.h"
+
+#include <mutex>
+#include <memory>
+#include <atomic>
 
 #ifdef _BUILD_TESTS
 #include <gtest/gtest_prod.h>
@@ -11,18 +25,47 @@ class UrlPreview
 {
 public:
 	UrlPreview(LemonBot *bot);
+	bool Init() override;
 	ProcessingResult HandleMessage(const ChatMessage &msg) final;
 	const std::string GetHelp() const override;
 
 private:
 	std::string getTitle(const std::string &content) const;
-	std::string getMetaCodepage(const std::string &content) const;
+	std::string getTitle(const HTMLHeadScanner &scanner, const std::string &contentType) const;
+
+	FetchRequest makePageRequest(const std::string &url) const;
+	static void attachScanner(FetchRequest &request, HTMLHeadScanner &scanner);
+	std::optional<std::string> getPageTitle(const FetchResult &page, const HTMLHeadScanner &scanner) const;
+
+	std::optional<OEmbedProvider> findOEmbedProvider(const URL &site) const;
+	FetchRequest makeOEmbedRequest(const OEmbedProvider &provider, const std::string &url) const;
+	std::optional<std::string> getOEmbedTitle(const OEmbedProvider &provider, const FetchResult &result) const;
+
+	std::vector<DB::CatalogURL> findUrlsInHistory(const std::string &request);
+	std::string concatenateURLs(const std::vector<DB::CatalogURL> &urls, bool withIndices) const;
+	void LogURL(const std::string &url, const std::string &key, const std::string &title, const std::string &poster);
 
-	std::vector<DB::LoggedURL> findUrlsInHistory(const std::string &request);
-	std::string concatenateURLs(const std::vector<DB::LoggedURL> &urls, bool withIndices) const;
-	void StoreRecord(const std::string &record);
+	std::string canonicalize(const std::string &url) const;
+	int fillCanonicalKeys(Storage &storage);
+
+	void recordFetch(const FetchResult &result);
+	void recordCacheHit(const std::string &url);
+	void pruneTelemetry();
+	std::string formatFetchStats(int hours);
+
+	void seedRecentLinks(int maxEntries);
+	static std::string formatRepost(const RecentLinks::Posting &posting, const std::string &title);
+
+	int ArchiveOlderThan(Storage &storage, long horizon);
+	int applyRetention();
+	void warmTitleCache(int maxEntries);
+	std::vector<ArchivedURL> findUrlsInArchive(const std::string &request);
+	std::string concatenateArchivedURLs(const std::vector<ArchivedURL> &urls) const;
+	URLArchive getArchive() const;
 
 	bool shouldPrintTitle(const std::string &url);
+	std::shared_ptr<const URLRuleSet> getRuleSet();
+	void invalidateRuleSet();
 	bool addRuleToRuleset(const std::string &rule, bool blacklist);
 	bool delRuleFromRuleset(int ruleID);
 	std::string ShowURLRules();
@@ -31,10 +74,42 @@ private:
 	static constexpr int maxLength = 500;
 	static constexpr int maxURLsInOneMessage = 5;
 	static constexpr int maxURLsInSearch = 15;
+	static constexpr int defaultFetchBudgetMs = 3000;
+	static constexpr int defaultMaxFetchBytes = 256 * 1024;
+	static constexpr int defaultTitleCacheSize = 1000;
+	static constexpr int defaultTitleCacheTTL = 6 * 60 * 60;
+	static constexpr int defaultTitleCacheFailureTTL = 5 * 60;
+	static constexpr int defaultRepostWindowMinutes = 60;
+	static constexpr int defaultRepostIndexSize = 5000;
+	static constexpr size_t maxOEmbedBytes = 64 * 1024;
+	static constexpr int defaultTelemetryDays = 14;
+	static constexpr int defaultFetchStatsHours = 24;
+	static constexpr size_t maxHostsInFetchStats = 10;
+	static constexpr int retentionBatchSize = 1000;
+	static constexpr int retentionCheckHours = 6;
+
+	int _retentionDays = 0;
+	int _telemetryDays = 0;
+	std::atomic<bool> _isRetentionReported = false; // !urlretention waits for the result
+	std::unique_ptr<TitleCache> _titleCache;
+	std::unique_ptr<RecentLinks> _recentLinks;
+	OEmbedProviders _oembedProviders;
+	URLCanonicalizer _canonicalizer;
+	std::mutex _historyMutex;
+	std::mutex _ruleSetMutex;
+	std::shared_ptr<const URLRuleSet> _ruleSet; // built on first lookup, reset when rules change
+	std::unique_ptr<PeriodicTask> _telemetryTask;
+	std::unique_ptr<PeriodicTask> _retentionTask; // keep last, must stop before other members go away
 
 #ifdef _BUILD_TESTS
 	FRIEND_TEST(URLPreview, History);
 	FRIEND_TEST(URLPreview, GetTitle);
 	FRIEND_TEST(URLPreview, ConfigReader);
+	FRIEND_TEST(URLPreview, Retention);
+	FRIEND_TEST(URLPreview, Rules);
+	FRIEND_TEST(URLPreview, OEmbedProviders);
+	FRIEND_TEST(URLPreview, CanonicalKeys);
+	FRIEND_TEST(URLPreview, Reposts);
+	FRIEND_TEST(URLPreview, FetchTelemetry);
 #endif
 };
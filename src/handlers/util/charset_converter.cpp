@@ -0,0 +1,224 @@
+#include "charset_converter.h"
+
+#include <cerrno>
+#include <cctype>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+CharsetConverter::CharsetConverter(const std::string &charset)
+	: _iconv(iconv_open("UTF-8", charset.c_str()))
+{
+
+}
+
+CharsetConverter::~CharsetConverter()
+{
+	if (IsValid())
+		iconv_close(_iconv);
+}
+
+bool CharsetConverter::IsValid() const
+{
+	return _iconv != reinterpret_cast<iconv_t>(-1);
+}
+
+bool CharsetConverter::Convert(const char *data, size_t size, std::string &output)
+{
+	if (!IsValid())
+		return false;
+
+	_pending.append(data, size);
+
+	char *in = &_pending[0];
+	size_t inLeft = _pending.size();
+	char buffer[4096];
+	while (inLeft > 0)
+	{
+		char *out = buffer;
+		size_t outLeft = sizeof(buffer);
+		auto result = iconv(_iconv, &in, &inLeft, &out, &outLeft);
+		output.append(buffer, out - buffer);
+
+		if (result != static_cast<size_t>(-1))
+			continue;
+
+		if (errno == E2BIG)
+			continue;
+
+		if (errno == EINVAL) // incomplete sequence, wait for more input
+			break;
+
+		return false;
+	}
+
+	_pending.erase(0, _pending.size() - inLeft);
+	return true;
+}
+
+bool CharsetConverter::HasPending() const
+{
+	return !_pending.empty();
+}
+
+void CharsetConverter::Reset()
+{
+	_pending.clear();
+	if (IsValid())
+		iconv(_iconv, nullptr, nullptr, nullptr, nullptr);
+}
+
+std::optional<std::string> CharsetConverter::ToUTF8(const std::string &text, const std::string &charset)
+{
+	static std::mutex cacheMutex;
+	static std::unordered_map<std::string, std::unique_ptr<CharsetConverter>> cache;
+
+	auto name = NormalizeCharset(charset);
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	auto converter = cache.find(name);
+	if (converter == cache.end())
+	{
+		if (cache.size() >= maxCachedConverters)
+			cache.clear();
+		// Unknown charsets are cached too, so they fail without another iconv_open
+		converter = cache.emplace(name, std::make_unique<CharsetConverter>(name)).first;
+	}
+
+	auto &cached = *converter->second;
+	cached.Reset();
+
+	std::string output;
+	if (!cached.Convert(text.data(), text.size(), output) || cached.HasPending())
+		return {};
+
+	return output;
+}
+
+std::string CharsetConverter::NormalizeCharset(const std::string &charset)
+{
+	auto begin = charset.find_first_not_of(" \t\r\n\"'");
+	auto end = charset.find_last_not_of(" \t\r\n\"'");
+	if (begin == std::string::npos)
+		return "";
+
+	auto name = charset.substr(begin, end + 1 - begin);
+	std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+		return static_cast<char>(std::tolower(c));
+	});
+
+	static const std::unordered_map<std::string, std::string> aliases = {
+		{ "utf8", "utf-8" },
+		{ "unicode-1-1-utf-8", "utf-8" },
+		{ "us-ascii", "windows-1252" },
+		{ "ascii", "windows-1252" },
+		{ "latin1", "windows-1252" },
+		{ "iso-8859-1", "windows-1252" },
+		{ "iso8859-1", "windows-1252" },
+		{ "cp1251", "windows-1251" },
+		{ "win-1251", "windows-1251" },
+		{ "x-cp1251", "windows-1251" },
+		{ "cp1252", "windows-1252" },
+	};
+
+	auto alias = aliases.find(name);
+	return alias != aliases.end() ? alias->second : name;
+}
+
+bool CharsetConverter::IsSingleByte(const std::string &charset)
+{
+	auto name = NormalizeCharset(charset);
+	for (const std::string prefix : { "windows-125", "iso-8859-", "koi8-" })
+	{
+		if (name.compare(0, prefix.size(), prefix) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool CharsetConverter::IsValidUTF8(const std::string &text)
+{
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		auto c = static_cast<unsigned char>(text[pos]);
+		size_t length;
+		unsigned int codepoint;
+		if (c < 0x80) {
+			pos++;
+			continue;
+		} else if ((c & 0xE0) == 0xC0) {
+			length = 2;
+			codepoint = c & 0x1F;
+		} else if ((c & 0xF0) == 0xE0) {
+			length = 3;
+			codepoint = c & 0x0F;
+		} else if ((c & 0xF8) == 0xF0) {
+			length = 4;
+			codepoint = c & 0x07;
+		} else {
+			return false;
+		}
+
+		if (pos + length > text.size())
+			return false;
+
+		for (size_t i = 1; i < length; i++)
+		{
+			auto next = static_cast<unsigned char>(text[pos + i]);
+			if ((next & 0xC0) != 0x80)
+				return false;
+			codepoint = (codepoint << 6) | (next & 0x3F);
+		}
+
+		// Overlong forms, surrogates and values past U+10FFFF
+		static const unsigned int minimum[] = { 0, 0, 0x80, 0x800, 0x10000 };
+		if (codepoint < minimum[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+			return false;
+
+		pos += length;
+	}
+
+	return true;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(CharsetConverter, Convert)
+{
+	EXPECT_EQ(u8"Привет", CharsetConverter::ToUTF8("\xcf\xf0\xe8\xe2\xe5\xf2", "Windows-1251").value_or(""));
+	EXPECT_EQ(u8"Привет", CharsetConverter::ToUTF8("\xf0\xd2\xc9\xd7\xc5\xd4", " \"KOI8-R\" ").value_or(""));
+	EXPECT_EQ(u8"café", CharsetConverter::ToUTF8("caf\xe9", "latin1").value_or(""));
+	EXPECT_FALSE(CharsetConverter::ToUTF8("test", "no-such-charset").has_value());
+	EXPECT_FALSE(CharsetConverter::ToUTF8("\xd0", "utf-8").has_value());
+
+	// Streaming keeps sequences split between chunks
+	CharsetConverter utf16("UTF-16LE");
+	std::string output;
+	std::string input("\x1f\x04\x40\x04", 4);
+	EXPECT_TRUE(utf16.Convert(input.data(), 3, output));
+	EXPECT_TRUE(utf16.HasPending());
+	EXPECT_TRUE(utf16.Convert(input.data() + 3, 1, output));
+	EXPECT_FALSE(utf16.HasPending());
+	EXPECT_EQ(u8"Пр", output);
+}
+
+TEST(CharsetConverter, ValidUTF8)
+{
+	EXPECT_TRUE(CharsetConverter::IsValidUTF8(u8"ascii, Кириллица, 😀"));
+	EXPECT_FALSE(CharsetConverter::IsValidUTF8("\xcf\xf0\xe8\xe2\xe5\xf2"));
+	EXPECT_FALSE(CharsetConverter::IsValidUTF8("\xc0\xaf"));
+	EXPECT_FALSE(CharsetConverter::IsValidUTF8("\xed\xa0\x80"));
+	EXPECT_FALSE(CharsetConverter::IsValidUTF8("\xf0\x9f\x98"));
+
+	EXPECT_TRUE(CharsetConverter::IsSingleByte("ISO-8859-1"));
+	EXPECT_TRUE(CharsetConverter::IsSingleByte("cp1251"));
+	EXPECT_TRUE(CharsetConverter::IsSingleByte("koi8-r"));
+	EXPECT_FALSE(CharsetConverter::IsSingleByte("utf-8"));
+	EXPECT_FALSE(CharsetConverter::IsSingleByte("shift_jis"));
+}
+
+#endif // LCOV_EXCL_STOP
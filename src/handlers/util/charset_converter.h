@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <optional>
+
+#include <iconv.h>
+
+/**
+ * iconv based conversion to UTF-8.
+ *
+ * An instance converts a stream: incomplete multibyte sequences at the end of
+ * a chunk are kept until the next one. ToUTF8 converts short strings with
+ * converters cached per charset, so iconv_open runs once per charset.
+ */
+class CharsetConverter
+{
+public:
+	explicit CharsetConverter(const std::string &charset);
+	~CharsetConverter();
+
+	CharsetConverter(const CharsetConverter &) = delete;
+	CharsetConverter &operator=(const CharsetConverter &) = delete;
+
+	bool IsValid() const;
+
+	// Appends converted data to output, returns false on invalid input
+	bool Convert(const char *data, size_t size, std::string &output);
+	bool HasPending() const;
+	void Reset();
+
+	static std::optional<std::string> ToUTF8(const std::string &text, const std::string &charset);
+
+	// Lowercase charset label with common aliases resolved the way browsers do
+	static std::string NormalizeCharset(const std::string &charset);
+	static bool IsValidUTF8(const std::string &text);
+	// windows-125x, iso-8859-x and koi8 family, any byte sequence is valid in them
+	static bool IsSingleByte(const std::string &charset);
+
+private:
+	static constexpr size_t maxCachedConverters = 32;
+
+	iconv_t _iconv;
+	std::string _pending;
+};
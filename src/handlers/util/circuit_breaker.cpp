@@ -0,0 +1,117 @@
+#include "circuit_breaker.h"
+
+#include <algorithm>
+
+CircuitBreaker::CircuitBreaker(int failureThreshold, std::chrono::seconds openDuration)
+	: _failureThreshold(failureThreshold)
+	, _openDuration(openDuration)
+{
+
+}
+
+bool CircuitBreaker::Allow(Clock::time_point now)
+{
+	switch (GetState(now))
+	{
+	case State::Closed:
+		return true;
+	case State::Open:
+		return false;
+	case State::HalfOpen:
+		if (_isProbing)
+			return false;
+		_isProbing = true;
+		return true;
+	}
+
+	return false;
+}
+
+void CircuitBreaker::Record(bool success, Clock::time_point now)
+{
+	if (success)
+	{
+		_failures = 0;
+		_isOpen = false;
+		_isProbing = false;
+		return;
+	}
+
+	// A failed probe or one failure too many opens the circuit for another period
+	if (_isProbing || ++_failures >= _failureThreshold)
+	{
+		_isOpen = _failureThreshold > 0;
+		_isProbing = false;
+		_openedAt = now;
+	}
+}
+
+CircuitBreaker::State CircuitBreaker::GetState(Clock::time_point now) const
+{
+	if (!_isOpen)
+		return State::Closed;
+
+	return now - _openedAt < _openDuration ? State::Open : State::HalfOpen;
+}
+
+std::chrono::seconds CircuitBreaker::GetRetryIn(Clock::time_point now) const
+{
+	if (GetState(now) != State::Open)
+		return std::chrono::seconds(0);
+
+	return std::max(std::chrono::seconds(1),
+					std::chrono::duration_cast<std::chrono::seconds>(_openedAt + _openDuration - now));
+}
+
+void CircuitBreaker::SetPolicy(int failureThreshold, std::chrono::seconds openDuration)
+{
+	_failureThreshold = failureThreshold;
+	_openDuration = openDuration;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(CircuitBreaker, States)
+{
+	using std::chrono::seconds;
+
+	CircuitBreaker breaker(3, seconds(30));
+	auto now = CircuitBreaker::Clock::now();
+
+	breaker.Record(false, now);
+	breaker.Record(false, now);
+	breaker.Record(true, now);
+	breaker.Record(false, now);
+	breaker.Record(false, now);
+	EXPECT_EQ(CircuitBreaker::State::Closed, breaker.GetState(now));
+	EXPECT_TRUE(breaker.Allow(now));
+
+	breaker.Record(false, now);
+	EXPECT_EQ(CircuitBreaker::State::Open, breaker.GetState(now));
+	EXPECT_FALSE(breaker.Allow(now + seconds(10)));
+	EXPECT_EQ(seconds(20), breaker.GetRetryIn(now + seconds(10)));
+
+	// One probe at a time, failed probe reopens
+	auto later = now + seconds(31);
+	EXPECT_EQ(CircuitBreaker::State::HalfOpen, breaker.GetState(later));
+	EXPECT_TRUE(breaker.Allow(later));
+	EXPECT_FALSE(breaker.Allow(later));
+	breaker.Record(false, later);
+	EXPECT_EQ(CircuitBreaker::State::Open, breaker.GetState(later + seconds(29)));
+
+	later += seconds(30);
+	EXPECT_TRUE(breaker.Allow(later));
+	breaker.Record(true, later);
+	EXPECT_EQ(CircuitBreaker::State::Closed, breaker.GetState(later));
+	EXPECT_TRUE(breaker.Allow(later));
+	EXPECT_TRUE(breaker.Allow(later));
+
+	CircuitBreaker disabled(0, seconds(30));
+	for (int i = 0; i < 10; i++)
+		disabled.Record(false, now);
+	EXPECT_TRUE(disabled.Allow(now));
+}
+
+#endif // LCOV_EXCL_STOP
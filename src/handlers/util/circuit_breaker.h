@@ -0,0 +1,43 @@
+#pragma once
+
+#include <chrono>
+
+/**
+ * Consecutive-failure circuit breaker for one remote host.
+ *
+ * Closed: everything goes through. After failureThreshold failures in a row
+ * it opens and rejects requests for openDuration, then lets a single probe
+ * through (half-open). A successful probe closes it, a failed one opens it again.
+ * Not synchronized, the owner locks.
+ */
+class CircuitBreaker
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	enum class State
+	{
+		Closed,
+		Open,
+		HalfOpen,
+	};
+
+	CircuitBreaker(int failureThreshold, std::chrono::seconds openDuration);
+
+	bool Allow(Clock::time_point now = Clock::now());
+	void Record(bool success, Clock::time_point now = Clock::now());
+
+	State GetState(Clock::time_point now = Clock::now()) const;
+	std::chrono::seconds GetRetryIn(Clock::time_point now = Clock::now()) const;
+
+	void SetPolicy(int failureThreshold, std::chrono::seconds openDuration);
+
+private:
+	int _failureThreshold;
+	std::chrono::seconds _openDuration;
+
+	int _failures = 0;
+	bool _isOpen = false;
+	bool _isProbing = false;
+	Clock::time_point _openedAt = {};
+};
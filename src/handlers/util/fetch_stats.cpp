@@ -0,0 +1,111 @@
+#include "fetch_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void FetchStats::Add(const DB::URLFetch &fetch)
+{
+	if (fetch.cacheHit)
+	{
+		_cacheHits++;
+		return;
+	}
+
+	_fetches++;
+	_failed += fetch.failed;
+	_bytes += fetch.bytes;
+
+	auto &host = _hosts[fetch.host];
+	host._fetches++;
+	host._failed += fetch.failed;
+	host._bytes += fetch.bytes;
+	host._dnsMs += fetch.dnsMs;
+	host._connectMs += fetch.connectMs;
+	host._tlsMs += fetch.tlsMs;
+	host._firstByteMs += fetch.firstByteMs;
+	host._totalMs += fetch.totalMs;
+	host._times.push_back(fetch.totalMs);
+	if (!fetch.httpVersion.empty())
+		host._httpVersions[fetch.httpVersion]++;
+}
+
+std::string FetchStats::Format(size_t maxHosts) const
+{
+	std::string result = "URL fetches: " + std::to_string(_fetches)
+			+ ", cache hits: " + std::to_string(_cacheHits)
+			+ ", failed: " + std::to_string(_failed)
+			+ ", received " + formatBytes(_bytes);
+
+	std::vector<std::pair<std::string, const HostStats*>> hosts;
+	for (const auto &host : _hosts)
+		hosts.emplace_back(host.first, &host.second);
+
+	std::sort(hosts.begin(), hosts.end(), [](const auto &a, const auto &b) {
+		return a.second->_totalMs > b.second->_totalMs;
+	});
+
+	if (hosts.size() > maxHosts)
+		hosts.resize(maxHosts);
+
+	for (const auto &[name, host] : hosts)
+	{
+		auto times = host->_times;
+		auto p95 = times.begin() + times.size() * 95 / 100;
+		std::nth_element(times.begin(), p95, times.end());
+
+		auto average = [&host = host](long total) { return std::to_string(total / host->_fetches); };
+		result += "\n" + name + ": " + std::to_string(host->_fetches) + " fetches, "
+				+ std::to_string(host->_totalMs) + " ms total, avg " + average(host->_totalMs) + " ms"
+				+ " (dns " + average(host->_dnsMs)
+				+ ", connect " + average(host->_connectMs)
+				+ ", tls " + average(host->_tlsMs)
+				+ ", first byte " + average(host->_firstByteMs) + ")"
+				+ ", p95 " + std::to_string(*p95) + " ms";
+
+		if (host->_failed > 0)
+			result += ", " + std::to_string(host->_failed) + " failed";
+
+		auto version = std::max_element(host->_httpVersions.begin(), host->_httpVersions.end(),
+										[](const auto &a, const auto &b) { return a.second < b.second; });
+		if (version != host->_httpVersions.end())
+			result += ", HTTP/" + version->first;
+	}
+
+	return result;
+}
+
+std::string FetchStats::formatBytes(long bytes)
+{
+	char formatted[32];
+	if (bytes < 1024)
+		return std::to_string(bytes) + " B";
+	if (bytes < 1024 * 1024)
+		std::snprintf(formatted, sizeof(formatted), "%.1f KiB", bytes / 1024.0);
+	else
+		std::snprintf(formatted, sizeof(formatted), "%.1f MiB", bytes / (1024.0 * 1024.0));
+	return formatted;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(FetchStats, Format)
+{
+	FetchStats stats;
+	EXPECT_EQ("URL fetches: 0, cache hits: 0, failed: 0, received 0 B", stats.Format(5));
+
+	for (int i = 1; i <= 20; i++)
+		stats.Add({ -1, 0, "slow.com", 200, false, false, 10, 20, 30, 40 * i, 100 * i, 1024, "text/html", "2" });
+	stats.Add({ -1, 0, "fast.com", 0, true, false, 5, 0, 0, 0, 5, 0, "", "" });
+	stats.Add({ -1, 0, "fast.com", 0, false, true, 0, 0, 0, 0, 0, 0, "", "" });
+
+	EXPECT_EQ("URL fetches: 21, cache hits: 1, failed: 1, received 20.0 KiB\n"
+			  "slow.com: 20 fetches, 21000 ms total, avg 1050 ms (dns 10, connect 20, tls 30, first byte 420), p95 2000 ms, HTTP/2\n"
+			  "fast.com: 1 fetches, 5 ms total, avg 5 ms (dns 5, connect 0, tls 0, first byte 0), p95 5 ms, 1 failed",
+			  stats.Format(5));
+
+	EXPECT_EQ(std::string::npos, stats.Format(1).find("fast.com"));
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sqlite_db.h"
+
+/**
+ * Aggregates URL fetch telemetry rows per host, to see which hosts
+ * dominate preview latency.
+ */
+class FetchStats
+{
+public:
+	void Add(const DB::URLFetch &fetch);
+
+	// Totals and the hosts with the largest summed fetch time first
+	std::string Format(size_t maxHosts) const;
+
+private:
+	class HostStats
+	{
+	public:
+		long _fetches = 0;
+		long _failed = 0;
+		long _bytes = 0;
+		long _dnsMs = 0;
+		long _connectMs = 0;
+		long _tlsMs = 0;
+		long _firstByteMs = 0;
+		long _totalMs = 0;
+		std::vector<int> _times;
+		std::map<std::string, long> _httpVersions;
+	};
+
+	static std::string formatBytes(long bytes);
+
+	long _fetches = 0;
+	long _cacheHits = 0;
+	long _failed = 0;
+	long _bytes = 0;
+	std::map<std::string, HostStats> _hosts;
+};
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Generates html_entities_table.inc: HTML5 named character references in a
+# perfect hash table (hash and displace). Run from this directory:
+#   python3 gen_html_entities.py > html_entities_table.inc
+
+import html.entities
+
+TABLE_SIZE = 4096  # power of two, ~55% load
+BUCKETS = 1024
+
+
+def entity_hash(name, seed):
+    # Must match entityHash() in html_entities.cpp
+    h = (2166136261 ^ seed) & 0xffffffff
+    for c in name.encode():
+        h ^= c
+        h = (h * 16777619) & 0xffffffff
+    return h
+
+
+def build(entities):
+    buckets = [[] for _ in range(BUCKETS)]
+    for name in entities:
+        buckets[entity_hash(name, 0) % BUCKETS].append(name)
+
+    slots = [None] * TABLE_SIZE
+    displacements = [0] * BUCKETS
+    for index in sorted(range(BUCKETS), key=lambda i: -len(buckets[i])):
+        names = buckets[index]
+        if not names:
+            continue
+        seed = 1
+        while True:
+            positions = [entity_hash(name, seed) % TABLE_SIZE for name in names]
+            if len(set(positions)) == len(positions) and all(slots[p] is None for p in positions):
+                break
+            seed += 1
+        displacements[index] = seed
+        for name, position in zip(names, positions):
+            slots[position] = name
+    return displacements, slots
+
+
+def literal(value):
+    return '"' + ''.join('\\x%02x' % b for b in value.encode()) + '"'
+
+
+def main():
+    entities = html.entities.html5
+    displacements, slots = build(entities)
+    legacy = [name for name in entities if not name.endswith(';')]
+
+    print('// Generated by gen_html_entities.py, do not edit')
+    print()
+    print('constexpr size_t entityTableSize = %d;' % TABLE_SIZE)
+    print('constexpr size_t entityBuckets = %d;' % BUCKETS)
+    print('constexpr size_t maxEntityLength = %d;' % max(len(name) for name in entities))
+    print('constexpr size_t maxLegacyEntityLength = %d;' % max(len(name) for name in legacy))
+    print()
+    print('constexpr uint16_t entityDisplacements[entityBuckets] = {')
+    for i in range(0, BUCKETS, 16):
+        print('\t' + ' '.join('%d,' % d for d in displacements[i:i + 16]))
+    print('};')
+    print()
+    print('constexpr HTMLEntity entityTable[entityTableSize] = {')
+    for name in slots:
+        if name is None:
+            print('\t{ nullptr, nullptr },')
+        else:
+            print('\t{ "%s", %s },' % (name, literal(entities[name])))
+    print('};')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,214 @@
+#include "html_entities.h"
+
+#include <cstdint>
+
+namespace {
+
+struct HTMLEntity
+{
+	const char *name;
+	const char *value;
+};
+
+#include "html_entities_table.inc"
+
+constexpr uint32_t entityHash(std::string_view name, uint32_t seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+	for (char c : name)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+const char *findEntity(std::string_view name)
+{
+	auto seed = entityDisplacements[entityHash(name, 0) % entityBuckets];
+	const auto &entity = entityTable[entityHash(name, seed) % entityTableSize];
+	if (entity.name == nullptr || name != entity.name)
+		return nullptr;
+	return entity.value;
+}
+
+// Numeric references to C1 controls mean windows-1252 characters
+constexpr uint16_t windows1252[32] = {
+	0x20AC, 0x81, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x8D, 0x017D, 0x8F,
+	0x90, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x9D, 0x017E, 0x0178,
+};
+
+void appendUTF8(std::string &output, uint32_t codepoint)
+{
+	if (codepoint == 0 || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+		codepoint = 0xFFFD;
+	else if (codepoint >= 0x80 && codepoint <= 0x9F)
+		codepoint = windows1252[codepoint - 0x80];
+
+	if (codepoint < 0x80)
+	{
+		output += static_cast<char>(codepoint);
+	} else if (codepoint < 0x800) {
+		output += static_cast<char>(0xC0 | (codepoint >> 6));
+		output += static_cast<char>(0x80 | (codepoint & 0x3F));
+	} else if (codepoint < 0x10000) {
+		output += static_cast<char>(0xE0 | (codepoint >> 12));
+		output += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		output += static_cast<char>(0x80 | (codepoint & 0x3F));
+	} else {
+		output += static_cast<char>(0xF0 | (codepoint >> 18));
+		output += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+		output += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		output += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+}
+
+bool isAlnum(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+// Decodes the reference at input[pos] == '&', returns its length or 0 if there is none
+size_t decodeNumeric(std::string_view input, size_t pos, std::string &output)
+{
+	size_t end = pos + 2;
+	bool isHex = end < input.size() && (input[end] == 'x' || input[end] == 'X');
+	if (isHex)
+		end++;
+
+	size_t digitsBegin = end;
+	uint32_t codepoint = 0;
+	for (; end < input.size(); end++)
+	{
+		int digit = isHex ? hexValue(input[end]) : (input[end] >= '0' && input[end] <= '9' ? input[end] - '0' : -1);
+		if (digit < 0)
+			break;
+		// Saturate, anything this large is replaced anyway
+		codepoint = codepoint > 0x10FFFF ? codepoint : codepoint * (isHex ? 16 : 10) + digit;
+	}
+
+	if (end == digitsBegin)
+		return 0;
+
+	if (end < input.size() && input[end] == ';')
+		end++;
+
+	appendUTF8(output, codepoint);
+	return end - pos;
+}
+
+size_t decodeNamed(std::string_view input, size_t pos, std::string &output)
+{
+	size_t nameBegin = pos + 1;
+	size_t nameEnd = nameBegin;
+	while (nameEnd < input.size() && nameEnd - nameBegin < maxEntityLength && isAlnum(input[nameEnd]))
+		nameEnd++;
+
+	if (nameEnd == nameBegin)
+		return 0;
+
+	if (nameEnd < input.size() && input[nameEnd] == ';')
+	{
+		if (auto value = findEntity(input.substr(nameBegin, nameEnd + 1 - nameBegin)))
+		{
+			output += value;
+			return nameEnd + 1 - pos;
+		}
+	}
+
+	// Legacy entities like &amp or &copy work without ';', the longest one wins
+	for (size_t length = std::min(nameEnd - nameBegin, maxLegacyEntityLength); length > 0; length--)
+	{
+		if (auto value = findEntity(input.substr(nameBegin, length)))
+		{
+			output += value;
+			return length + 1;
+		}
+	}
+
+	return 0;
+}
+
+}
+
+std::string decodeHTMLEntities(std::string_view input)
+{
+	std::string output;
+	output.reserve(input.size());
+
+	size_t pos = 0;
+	while (pos < input.size())
+	{
+		auto ampersand = input.find('&', pos);
+		if (ampersand == std::string_view::npos)
+		{
+			output.append(input.substr(pos));
+			break;
+		}
+
+		output.append(input.substr(pos, ampersand - pos));
+
+		size_t length = 0;
+		if (ampersand + 1 < input.size())
+			length = input[ampersand + 1] == '#'
+					? decodeNumeric(input, ampersand, output)
+					: decodeNamed(input, ampersand, output);
+
+		if (length == 0)
+		{
+			output += '&';
+			length = 1;
+		}
+
+		pos = ampersand + length;
+	}
+
+	return output;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(HTMLEntities, Named)
+{
+	EXPECT_EQ("\"&><'", decodeHTMLEntities("&quot;&amp;&gt;&lt;&apos;"));
+	EXPECT_EQ(u8"a — b – c • d", decodeHTMLEntities("a &mdash; b &ndash; c &bull; d"));
+	EXPECT_EQ(u8"≫⃒ ∳", decodeHTMLEntities("&nGt; &CounterClockwiseContourIntegral;"));
+	EXPECT_EQ(u8"© 2017 &unknown; & &;", decodeHTMLEntities("&copy 2017 &unknown; & &;"));
+	EXPECT_EQ(u8"¬it; ∉", decodeHTMLEntities("&notit; &notin;"));
+	EXPECT_EQ("&", decodeHTMLEntities("&"));
+	EXPECT_EQ("", decodeHTMLEntities(""));
+	EXPECT_EQ("&&amp;", decodeHTMLEntities("&&amp;amp;"));
+}
+
+TEST(HTMLEntities, Numeric)
+{
+	EXPECT_EQ("''", decodeHTMLEntities("&#39;&#x27;"));
+	EXPECT_EQ(u8"😀 €", decodeHTMLEntities("&#X1F600; &#128;"));
+	EXPECT_EQ(u8"A���", decodeHTMLEntities("&#65&#0;&#xD800;&#99999999999;"));
+	EXPECT_EQ("&#; &#x;", decodeHTMLEntities("&#; &#x;"));
+}
+
+TEST(HTMLEntities, AllNamed)
+{
+	for (const auto &entity : entityTable)
+	{
+		if (entity.name == nullptr)
+			continue;
+		EXPECT_EQ(entity.value, decodeHTMLEntities("&" + std::string(entity.name))) << entity.name;
+	}
+}
+
+#endif // LCOV_EXCL_STOP
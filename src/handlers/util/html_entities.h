@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/**
+ * Decodes HTML character references in a single pass: all HTML5 named
+ * entities (including the legacy ones allowed without ';') and decimal or
+ * hexadecimal numeric references. Unknown references are kept as is.
+ */
+std::string decodeHTMLEntities(std::string_view input);
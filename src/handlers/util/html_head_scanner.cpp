@@ -0,0 +1,442 @@
+#include "html_head_scanner.h"
+
+#include <cctype>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+namespace {
+
+bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+char lower(char c)
+{
+	return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+std::string toLowerASCII(std::string_view input)
+{
+	std::string output(input);
+	std::transform(output.begin(), output.end(), output.begin(), lower);
+	return output;
+}
+
+bool startsWithNoCase(std::string_view input, size_t pos, std::string_view lowercasePrefix)
+{
+	if (pos + lowercasePrefix.size() > input.size())
+		return false;
+
+	for (size_t i = 0; i < lowercasePrefix.size(); i++)
+		if (lower(input[pos + i]) != lowercasePrefix[i])
+			return false;
+
+	return true;
+}
+
+std::vector<std::pair<std::string, std::string>> parseAttributes(std::string_view input)
+{
+	std::vector<std::pair<std::string, std::string>> attributes;
+
+	size_t pos = 0;
+	while (pos < input.size())
+	{
+		while (pos < input.size() && (isSpace(input[pos]) || input[pos] == '/'))
+			pos++;
+
+		size_t nameBegin = pos;
+		while (pos < input.size() && !isSpace(input[pos]) && input[pos] != '=' && input[pos] != '/')
+			pos++;
+		if (pos == nameBegin)
+			break;
+
+		auto name = toLowerASCII(input.substr(nameBegin, pos - nameBegin));
+		while (pos < input.size() && isSpace(input[pos]))
+			pos++;
+
+		std::string value;
+		if (pos < input.size() && input[pos] == '=')
+		{
+			pos++;
+			while (pos < input.size() && isSpace(input[pos]))
+				pos++;
+
+			if (pos < input.size() && (input[pos] == '"' || input[pos] == '\''))
+			{
+				auto quote = input[pos++];
+				auto valueEnd = std::min(input.find(quote, pos), input.size());
+				value = input.substr(pos, valueEnd - pos);
+				pos = valueEnd + 1;
+			} else {
+				size_t valueBegin = pos;
+				while (pos < input.size() && !isSpace(input[pos]))
+					pos++;
+				value = input.substr(valueBegin, pos - valueBegin);
+			}
+		}
+
+		attributes.emplace_back(std::move(name), std::move(value));
+	}
+
+	return attributes;
+}
+
+}
+
+bool HTMLHeadScanner::Feed(const char *data, size_t size)
+{
+	if (_isDone)
+		return false;
+
+	if (_isBOMChecked)
+		return append(data, size);
+
+	_prefix.append(data, size);
+	if (_prefix.size() < 3)
+		return true;
+
+	_isBOMChecked = true;
+	std::string prefix;
+	std::swap(prefix, _prefix);
+
+	size_t bomSize = 0;
+	if (prefix.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+		bomSize = 3;
+	} else if (prefix.compare(0, 2, "\xFE\xFF") == 0) {
+		bomSize = 2;
+		_decoder = std::make_unique<CharsetConverter>("UTF-16BE");
+	} else if (prefix.compare(0, 2, "\xFF\xFE") == 0) {
+		bomSize = 2;
+		_decoder = std::make_unique<CharsetConverter>("UTF-16LE");
+	}
+
+	if (bomSize > 0)
+	{
+		_hasBOM = true;
+		_charset = "utf-8";
+	}
+
+	return append(prefix.data() + bomSize, prefix.size() - bomSize);
+}
+
+bool HTMLHeadScanner::Feed(const std::string &data)
+{
+	return Feed(data.data(), data.size());
+}
+
+bool HTMLHeadScanner::IsDone() const
+{
+	return _isDone;
+}
+
+std::optional<std::string> HTMLHeadScanner::GetTitle() const
+{
+	if (_titleEnd == std::string::npos)
+		return {};
+
+	return _head.substr(_titleBegin, _titleEnd - _titleBegin);
+}
+
+const std::string &HTMLHeadScanner::GetCharset() const
+{
+	return _charset;
+}
+
+bool HTMLHeadScanner::HasBOM() const
+{
+	return _hasBOM;
+}
+
+std::string HTMLHeadScanner::GetContentTypeCharset(std::string_view contentType)
+{
+	auto lowercase = toLowerASCII(contentType);
+
+	size_t pos = 0;
+	while ((pos = lowercase.find("charset", pos)) != std::string::npos)
+	{
+		pos += 7;
+		while (pos < lowercase.size() && isSpace(lowercase[pos]))
+			pos++;
+		if (pos >= lowercase.size() || lowercase[pos] != '=')
+			continue;
+
+		pos++;
+		while (pos < lowercase.size() && isSpace(lowercase[pos]))
+			pos++;
+		if (pos < lowercase.size() && (lowercase[pos] == '"' || lowercase[pos] == '\''))
+			pos++;
+
+		auto end = lowercase.find_first_of(" \t;\"'", pos);
+		return lowercase.substr(pos, end == std::string::npos ? end : end - pos);
+	}
+
+	return "";
+}
+
+bool HTMLHeadScanner::append(const char *data, size_t size)
+{
+	if (_decoder)
+	{
+		if (!_decoder->Convert(data, size, _head))
+		{
+			LOG(INFO) << "Invalid UTF-16 in document head";
+			_isDone = true;
+			return false;
+		}
+	} else {
+		_head.append(data, size);
+	}
+
+	scan();
+	return !_isDone;
+}
+
+void HTMLHeadScanner::scan()
+{
+	// Incomplete constructs at the end are left for the next call, _pos stays at their start
+	while (!_isDone)
+	{
+		if (!_rawTextEnd.empty())
+		{
+			auto close = findRawTextEnd(_pos);
+			if (close == std::string::npos)
+			{
+				auto safe = _head.size() > _rawTextEnd.size() ? _head.size() - _rawTextEnd.size() : 0;
+				_pos = std::max(_pos, safe);
+				return;
+			}
+
+			if (_rawTextEnd == "</title")
+				_titleEnd = close;
+			_rawTextEnd.clear();
+			_pos = close;
+		}
+
+		if (_titleEnd != std::string::npos && !_charset.empty())
+		{
+			_isDone = true;
+			return;
+		}
+
+		auto open = _head.find('<', _pos);
+		if (open == std::string::npos)
+		{
+			_pos = _head.size();
+			return;
+		}
+		_pos = open;
+
+		if (_head.size() - open < 4 && std::string_view("<!--").substr(0, _head.size() - open) == std::string_view(_head).substr(open))
+			return;
+
+		if (_head.compare(open, 4, "<!--") == 0)
+		{
+			auto end = _head.find("-->", open + 4);
+			if (end == std::string::npos)
+				return;
+			_pos = end + 3;
+			continue;
+		}
+
+		if (_head[open + 1] == '!' || _head[open + 1] == '?')
+		{
+			auto end = _head.find('>', open);
+			if (end == std::string::npos)
+				return;
+			_pos = end + 1;
+			continue;
+		}
+
+		bool isEndTag = _head[open + 1] == '/';
+		size_t nameBegin = open + 1 + isEndTag;
+		if (nameBegin >= _head.size())
+			return;
+
+		if (!std::isalpha(static_cast<unsigned char>(_head[nameBegin])))
+		{
+			_pos = open + 1; // stray '<' in text
+			continue;
+		}
+
+		auto tagEnd = findTagEnd(nameBegin);
+		if (tagEnd == std::string::npos)
+			return;
+
+		size_t nameEnd = nameBegin;
+		while (nameEnd < tagEnd && !isSpace(_head[nameEnd]) && _head[nameEnd] != '/')
+			nameEnd++;
+
+		auto name = toLowerASCII(std::string_view(_head).substr(nameBegin, nameEnd - nameBegin));
+		_pos = tagEnd + 1;
+
+		if (isEndTag)
+		{
+			if (name == "head")
+				_isDone = true;
+		} else if (name == "body") {
+			_isDone = true;
+		} else if (name == "title") {
+			if (_titleBegin == std::string::npos)
+			{
+				_titleBegin = _pos;
+				_rawTextEnd = "</title";
+			}
+		} else if (name == "script" || name == "style") {
+			_rawTextEnd = "</" + name;
+		} else if (name == "meta") {
+			parseMeta(std::string_view(_head).substr(nameEnd, tagEnd - nameEnd));
+		}
+	}
+}
+
+size_t HTMLHeadScanner::findTagEnd(size_t from) const
+{
+	char quote = 0;
+	char previous = 0;
+	for (size_t pos = from; pos < _head.size(); pos++)
+	{
+		char c = _head[pos];
+		if (quote != 0)
+		{
+			if (c == quote)
+				quote = 0;
+			continue;
+		}
+
+		if ((c == '"' || c == '\'') && previous == '=')
+			quote = c;
+		else if (c == '>')
+			return pos;
+
+		if (!isSpace(c))
+			previous = c;
+	}
+
+	return std::string::npos;
+}
+
+size_t HTMLHeadScanner::findRawTextEnd(size_t from) const
+{
+	for (auto pos = _head.find("</", from); pos != std::string::npos; pos = _head.find("</", pos + 1))
+	{
+		auto next = pos + _rawTextEnd.size();
+		if (next >= _head.size())
+			return std::string::npos;
+
+		if (startsWithNoCase(_head, pos, _rawTextEnd) && (isSpace(_head[next]) || _head[next] == '>' || _head[next] == '/'))
+			return pos;
+	}
+
+	return std::string::npos;
+}
+
+void HTMLHeadScanner::parseMeta(std::string_view attributes)
+{
+	std::string httpEquiv;
+	std::string content;
+	for (const auto &attribute : parseAttributes(attributes))
+	{
+		if (attribute.first == "charset")
+			setCharset(attribute.second);
+		else if (attribute.first == "http-equiv")
+			httpEquiv = toLowerASCII(attribute.second);
+		else if (attribute.first == "content")
+			content = attribute.second;
+	}
+
+	if (httpEquiv == "content-type")
+		setCharset(GetContentTypeCharset(content));
+}
+
+void HTMLHeadScanner::setCharset(const std::string &charset)
+{
+	// The first declaration wins, and <meta> can't really declare UTF-16
+	if (!_charset.empty())
+		return;
+
+	_charset = CharsetConverter::NormalizeCharset(charset);
+	if (_charset.compare(0, 6, "utf-16") == 0)
+		_charset = "utf-8";
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// Feeds the page in chunks of the given size, returns how much was consumed
+size_t feedInChunks(HTMLHeadScanner &scanner, const std::string &page, size_t chunk)
+{
+	size_t fed = 0;
+	while (fed < page.size() && scanner.Feed(page.data() + fed, std::min(chunk, page.size() - fed)))
+		fed += chunk;
+	return fed;
+}
+
+}
+
+TEST(HTMLHeadScanner, Chunks)
+{
+	std::string page = "<html><head><META Charset=\"UTF-8\"><titlex></titlex><!-- <title>comment</title> -->"
+					   "<script>var s = '<title>script</title>';</script>"
+					   "<TITLE lang=\"en\">  Some page </Title ><body>" + std::string(10000, 'x');
+
+	// Every possible split of the interesting part gives the same result
+	for (size_t chunk = 1; chunk < 80; chunk++)
+	{
+		HTMLHeadScanner scanner;
+		auto fed = feedInChunks(scanner, page, chunk);
+
+		ASSERT_TRUE(scanner.IsDone()) << chunk;
+		EXPECT_EQ("  Some page ", scanner.GetTitle().value_or("")) << chunk;
+		EXPECT_EQ("utf-8", scanner.GetCharset());
+		EXPECT_LT(fed, 250) << chunk;
+	}
+
+	HTMLHeadScanner noTitle;
+	EXPECT_TRUE(noTitle.Feed("<html><head><link rel=\"x\" href=\"a>b\">"));
+	EXPECT_FALSE(noTitle.Feed("</HEAD><body><title>late</title>"));
+	EXPECT_FALSE(noTitle.GetTitle().has_value());
+}
+
+TEST(HTMLHeadScanner, Charset)
+{
+	HTMLHeadScanner httpEquiv;
+	httpEquiv.Feed("<head><title>T</title><meta content='text/html; Charset=Windows-1251' HTTP-EQUIV=\"Content-Type\"></head>");
+	EXPECT_EQ("windows-1251", httpEquiv.GetCharset());
+	EXPECT_EQ("T", httpEquiv.GetTitle().value_or(""));
+
+	HTMLHeadScanner unquoted;
+	unquoted.Feed("<meta charset=koi8-r><title>T</title>");
+	EXPECT_EQ("koi8-r", unquoted.GetCharset());
+	EXPECT_TRUE(unquoted.IsDone());
+
+	HTMLHeadScanner undeclared;
+	EXPECT_TRUE(undeclared.Feed("<head><title>T</title>"));
+	EXPECT_EQ("", undeclared.GetCharset());
+
+	HTMLHeadScanner bom;
+	bom.Feed("\xEF\xBB\xBF<meta charset=\"windows-1251\"><title>T</title>");
+	EXPECT_TRUE(bom.HasBOM());
+	EXPECT_EQ("utf-8", bom.GetCharset());
+
+	std::string utf16("\xFF\xFE", 2);
+	for (char c : std::string("<title>Test</title>"))
+		utf16 += std::string{ c, '\0' };
+	for (size_t chunk = 1; chunk < 8; chunk++)
+	{
+		HTMLHeadScanner scanner;
+		feedInChunks(scanner, utf16, chunk);
+		EXPECT_EQ("Test", scanner.GetTitle().value_or("")) << chunk;
+	}
+
+	EXPECT_EQ("utf-8", HTMLHeadScanner::GetContentTypeCharset("text/html; charset=\"UTF-8\""));
+	EXPECT_EQ("", HTMLHeadScanner::GetContentTypeCharset("text/html"));
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include "charset_converter.h"
+
+/**
+ * Incremental tokenizer for the head of an HTML document coming in chunks.
+ *
+ * Picks the first <title> and the declared charset (byte order mark,
+ * <meta charset> or <meta http-equiv="Content-Type">). Tag and attribute
+ * names are case-insensitive, comments and script/style bodies are skipped,
+ * tags may span chunk boundaries. UTF-16 documents are converted to UTF-8
+ * on the fly. Scanning stops at </head> or <body>, or as soon as both the
+ * title and the charset are known.
+ */
+class HTMLHeadScanner
+{
+public:
+	// Returns false once nothing else is needed from the document
+	bool Feed(const char *data, size_t size);
+	bool Feed(const std::string &data);
+
+	bool IsDone() const;
+	std::optional<std::string> GetTitle() const;
+
+	// Lowercase charset label, empty if the document does not declare one
+	const std::string &GetCharset() const;
+	bool HasBOM() const;
+
+	// Charset parameter of a Content-Type value, e.g. "text/html; charset=utf-8"
+	static std::string GetContentTypeCharset(std::string_view contentType);
+
+private:
+	bool append(const char *data, size_t size);
+	void scan();
+	size_t findTagEnd(size_t from) const;
+	size_t findRawTextEnd(size_t from) const;
+	void parseMeta(std::string_view attributes);
+	void setCharset(const std::string &charset);
+
+	std::string _head; // UTF-8 for UTF-16 documents
+	std::string _prefix; // first bytes until the byte order mark is checked
+	std::unique_ptr<CharsetConverter> _decoder;
+
+	size_t _pos = 0;
+	std::string _rawTextEnd; // "</title", "</script" or "</style" while inside one
+	size_t _titleBegin = std::string::npos;
+	size_t _titleEnd = std::string::npos;
+	std::string _charset;
+	bool _isBOMChecked = false;
+	bool _hasBOM = false;
+	bool _isDone = false;
+};
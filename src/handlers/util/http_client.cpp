@@ -0,0 +1,489 @@
+#include "http_client.h"
+
+#include <cctype>
+#include <algorithm>
+
+#include <glog/logging.h>
+
+HttpClient::HttpClient()
+{
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+
+	_share = curl_share_init();
+	curl_share_setopt(_share, CURLSHOPT_LOCKFUNC, &HttpClient::lockShared);
+	curl_share_setopt(_share, CURLSHOPT_UNLOCKFUNC, &HttpClient::unlockShared);
+	curl_share_setopt(_share, CURLSHOPT_USERDATA, this);
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+HttpClient::~HttpClient()
+{
+	for (auto &host : _idle)
+		for (auto handle : host.second)
+			curl_easy_cleanup(handle);
+
+	for (auto multi : _idleMulti)
+		curl_multi_cleanup(multi);
+
+	curl_share_cleanup(_share);
+	curl_global_cleanup();
+}
+
+HttpResponse HttpClient::Get(const std::string &url, const std::vector<std::string> &headers, std::chrono::milliseconds timeout)
+{
+	return perform(url, nullptr, headers, timeout);
+}
+
+HttpResponse HttpClient::Post(const std::string &url, const std::string &body, const std::vector<std::string> &headers, std::chrono::milliseconds timeout)
+{
+	return perform(url, &body, headers, timeout);
+}
+
+void HttpClient::Configure(CURL *handle)
+{
+	curl_easy_setopt(handle, CURLOPT_SHARE, _share);
+	curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, dnsCacheSeconds);
+	curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+	curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, ""); // everything libcurl was built with
+	curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(handle, CURLOPT_MAXREDIRS, maxRedirects);
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+}
+
+CURLM *HttpClient::AcquireMulti()
+{
+	{
+		std::lock_guard<std::mutex> lock(_poolMutex);
+		if (!_idleMulti.empty())
+		{
+			auto multi = _idleMulti.back();
+			_idleMulti.pop_back();
+			return multi;
+		}
+	}
+
+	return curl_multi_init();
+}
+
+void HttpClient::ReleaseMulti(CURLM *multi)
+{
+	{
+		std::lock_guard<std::mutex> lock(_poolMutex);
+		if (_idleMulti.size() < maxIdleMulti)
+		{
+			_idleMulti.push_back(multi);
+			return;
+		}
+	}
+
+	curl_multi_cleanup(multi);
+}
+
+void HttpClient::SetHostPolicy(int maxPerHost, int breakerFailures, std::chrono::seconds breakerOpen)
+{
+	std::lock_guard<std::mutex> lock(_hostsMutex);
+	_maxPerHost = std::max(maxPerHost, 1);
+	_breakerFailures = breakerFailures;
+	_breakerOpen = breakerOpen;
+
+	for (auto &host : _hosts)
+		host.second._breaker.SetPolicy(breakerFailures, breakerOpen);
+	_slotFreed.notify_all();
+}
+
+HttpClient::Admission HttpClient::Admit(const std::string &url)
+{
+	std::lock_guard<std::mutex> lock(_hostsMutex);
+	auto &host = getHost(GetHost(url));
+
+	if (host._inFlight >= _maxPerHost)
+		return Admission::Busy;
+
+	if (!host._breaker.Allow())
+	{
+		host._rejected++;
+		return Admission::CircuitOpen;
+	}
+
+	host._inFlight++;
+	return Admission::Allowed;
+}
+
+void HttpClient::Complete(const std::string &url, CURL *handle, CURLcode result)
+{
+	long statusCode = 0;
+	long connects = 0;
+	long httpVersion = 0;
+	curl_off_t totalTime = 0;
+	curl_off_t tlsTime = 0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &statusCode);
+	curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+	curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &httpVersion);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &totalTime);
+	curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tlsTime);
+
+	// 4xx is the client's problem, the host itself is fine
+	bool isHostFailure = result != CURLE_OK || statusCode >= 500;
+
+	{
+		std::lock_guard<std::mutex> lock(_hostsMutex);
+		auto &host = getHost(GetHost(url));
+		host._inFlight--;
+		host._breaker.Record(!isHostFailure);
+
+		host._requests++;
+		host._failures += isHostFailure;
+		host._newConnections += connects;
+		host._tlsHandshakes += connects > 0 && tlsTime > 0;
+		host._http2 += httpVersion == CURL_HTTP_VERSION_2_0;
+		host._totalTime += std::chrono::microseconds(totalTime);
+		host._maxTime = std::max(host._maxTime, std::chrono::microseconds(totalTime));
+	}
+
+	_slotFreed.notify_all();
+}
+
+std::string HttpClient::GetStats() const
+{
+	std::vector<std::pair<std::string, HostStats>> hosts;
+	{
+		std::lock_guard<std::mutex> lock(_hostsMutex);
+		hosts.assign(_hosts.begin(), _hosts.end());
+	}
+
+	if (hosts.empty())
+		return "No HTTP requests yet";
+
+	std::sort(hosts.begin(), hosts.end(), [](const auto &lhs, const auto &rhs) {
+		return lhs.second._requests > rhs.second._requests;
+	});
+
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	std::string result = "HTTP hosts:";
+	for (size_t i = 0; i < hosts.size() && i < maxHostsInStats; i++)
+	{
+		const auto &stats = hosts[i].second;
+		result += "\n" + hosts[i].first + ": " + std::to_string(stats._requests) + " requests, "
+				+ std::to_string(stats._newConnections) + " connections ("
+				+ std::to_string(stats._tlsHandshakes) + " TLS handshakes), "
+				+ std::to_string(stats._http2) + " over HTTP/2";
+		if (stats._requests > 0)
+			result += ", avg " + std::to_string(duration_cast<milliseconds>(stats._totalTime / stats._requests).count()) + " ms, max "
+					+ std::to_string(duration_cast<milliseconds>(stats._maxTime).count()) + " ms";
+		if (stats._failures > 0)
+			result += ", " + std::to_string(stats._failures) + " failed";
+		if (stats._inFlight > 0)
+			result += ", " + std::to_string(stats._inFlight) + " in flight";
+
+		switch (stats._breaker.GetState())
+		{
+		case CircuitBreaker::State::Closed:
+			break;
+		case CircuitBreaker::State::Open:
+			result += ", circuit open (retry in " + std::to_string(stats._breaker.GetRetryIn().count()) + " s)";
+			break;
+		case CircuitBreaker::State::HalfOpen:
+			result += ", circuit half-open";
+			break;
+		}
+		if (stats._rejected > 0)
+			result += ", " + std::to_string(stats._rejected) + " rejected";
+	}
+
+	if (hosts.size() > maxHostsInStats)
+		result += "\n... and " + std::to_string(hosts.size() - maxHostsInStats) + " more";
+
+	return result;
+}
+
+std::string HttpClient::GetHost(const std::string &url)
+{
+	auto begin = url.find("://");
+	begin = begin == std::string::npos ? 0 : begin + 3;
+
+	auto end = url.find_first_of("/?#", begin);
+	auto host = url.substr(begin, end == std::string::npos ? end : end - begin);
+
+	auto credentials = host.rfind('@');
+	if (credentials != std::string::npos)
+		host.erase(0, credentials + 1);
+
+	// IPv6 literals keep their brackets, only a colon after "]" starts the port
+	auto port = host.rfind(':');
+	auto ipv6End = host.rfind(']');
+	if (port != std::string::npos && (ipv6End == std::string::npos || port > ipv6End))
+		host.erase(port);
+
+	std::transform(host.begin(), host.end(), host.begin(), [](unsigned char c) {
+		return static_cast<char>(std::tolower(c));
+	});
+	return host;
+}
+
+std::string HttpClient::UrlEncode(const std::string &input)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	std::string output;
+	output.reserve(input.size() * 3);
+	for (unsigned char c : input)
+	{
+		if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+		{
+			output += static_cast<char>(c);
+		} else {
+			output += '%';
+			output += hex[c >> 4];
+			output += hex[c & 0x0F];
+		}
+	}
+
+	return output;
+}
+
+std::string HttpClient::FormEncode(const std::vector<std::pair<std::string, std::string>> &fields)
+{
+	std::string output;
+	for (const auto &field : fields)
+	{
+		if (!output.empty())
+			output += '&';
+		output += UrlEncode(field.first) + "=" + UrlEncode(field.second);
+	}
+
+	return output;
+}
+
+HttpResponse HttpClient::perform(const std::string &url, const std::string *postBody,
+								 const std::vector<std::string> &headers, std::chrono::milliseconds timeout)
+{
+	HttpResponse response;
+	auto host = GetHost(url);
+
+	// Waiting for a free slot counts against the request timeout
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+	auto admission = Admit(url);
+	while (admission == Admission::Busy)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_hostsMutex);
+			if (!_slotFreed.wait_until(lock, deadline, [&] { return getHost(host)._inFlight < _maxPerHost; }))
+				break;
+		}
+		admission = Admit(url);
+	}
+
+	if (admission != Admission::Allowed)
+	{
+		response._error = admission == Admission::CircuitOpen ? "Circuit open for " + host : "Too many requests to " + host;
+		LOG(INFO) << "Not fetching " << url << ": " << response._error;
+		return response;
+	}
+
+	auto handle = acquire(host);
+	timeout = std::max(std::chrono::milliseconds(1),
+					   std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()));
+
+	curl_slist *headerList = nullptr;
+	for (const auto &header : headers)
+		headerList = curl_slist_append(headerList, header.c_str());
+
+	Configure(handle);
+	curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headerList);
+	curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.count()));
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &HttpClient::onData);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response._body);
+	if (postBody)
+	{
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, static_cast<long>(postBody->size()));
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDS, postBody->c_str());
+	}
+
+	auto result = curl_easy_perform(handle);
+	if (result != CURLE_OK)
+		response._error = curl_easy_strerror(result);
+
+	char *contentType = nullptr;
+	curl_off_t totalTime = 0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &response._statusCode);
+	curl_easy_getinfo(handle, CURLINFO_CONTENT_TYPE, &contentType);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &totalTime);
+	response._contentType = contentType ? contentType : "";
+	response._elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(totalTime));
+
+	Complete(url, handle, result);
+
+	curl_slist_free_all(headerList);
+	release(host, handle);
+	return response;
+}
+
+CURL *HttpClient::acquire(const std::string &host)
+{
+	{
+		std::lock_guard<std::mutex> lock(_poolMutex);
+		auto idle = _idle.find(host);
+		if (idle != _idle.end() && !idle->second.empty())
+		{
+			auto handle = idle->second.back();
+			idle->second.pop_back();
+			_idleCount--;
+			return handle;
+		}
+	}
+
+	return curl_easy_init();
+}
+
+void HttpClient::release(const std::string &host, CURL *handle)
+{
+	// Options go, live connections and caches stay
+	curl_easy_reset(handle);
+
+	CURL *evicted = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(_poolMutex);
+		_idle[host].push_back(handle);
+		if (++_idleCount > maxIdleHandles)
+		{
+			// Oldest handle of the host with most idle ones
+			auto largest = std::max_element(_idle.begin(), _idle.end(), [](const auto &lhs, const auto &rhs) {
+				return lhs.second.size() < rhs.second.size();
+			});
+			evicted = largest->second.front();
+			largest->second.erase(largest->second.begin());
+			_idleCount--;
+		}
+	}
+
+	if (evicted)
+		curl_easy_cleanup(evicted);
+}
+
+HttpClient::HostStats &HttpClient::getHost(const std::string &host)
+{
+	auto stats = _hosts.find(host);
+	if (stats == _hosts.end())
+		stats = _hosts.emplace(host, HostStats(_breakerFailures, _breakerOpen)).first;
+	return stats->second;
+}
+
+void HttpClient::lockShared(CURL *, curl_lock_data data, curl_lock_access, void *client)
+{
+	static_cast<HttpClient*>(client)->_shareMutexes[data].lock();
+}
+
+void HttpClient::unlockShared(CURL *, curl_lock_data data, void *client)
+{
+	static_cast<HttpClient*>(client)->_shareMutexes[data].unlock();
+}
+
+size_t HttpClient::onData(char *data, size_t size, size_t count, void *body)
+{
+	static_cast<std::string*>(body)->append(data, size * count);
+	return size * count;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <atomic>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(HttpClient, Encoding)
+{
+	EXPECT_EQ("Hello%20W%C3%B6rld%21~", HttpClient::UrlEncode(u8"Hello Wörld!~"));
+	EXPECT_EQ("username=Bob&content=a%26b%3Dc", HttpClient::FormEncode({ { "username", "Bob" }, { "content", "a&b=c" } }));
+	EXPECT_EQ("example.com", HttpClient::GetHost("https://user:pw@Example.com:8080/path?q#f"));
+	EXPECT_EQ("ya.ru", HttpClient::GetHost("http://ya.ru"));
+	EXPECT_EQ("[::1]", HttpClient::GetHost("http://[::1]:8080/"));
+	EXPECT_EQ("[2001:db8::1]", HttpClient::GetHost("https://[2001:DB8::1]/path"));
+}
+
+TEST(HttpClient, KeepAlive)
+{
+	// Minimal keep-alive HTTP/1.1 server counting accepted connections
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	ASSERT_EQ(0, bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+	ASSERT_EQ(0, listen(server, 4));
+	ASSERT_EQ(0, getsockname(server, reinterpret_cast<sockaddr*>(&address), &addressLength));
+
+	const int requestCount = 3;
+	std::atomic<int> connections = 0;
+	std::thread serverThread([&] {
+		int served = 0;
+		while (served < requestCount)
+		{
+			int client = accept(server, nullptr, nullptr);
+			connections++;
+			std::string request;
+			char buffer[4096];
+			ssize_t received;
+			while (served < requestCount && (received = recv(client, buffer, sizeof(buffer), 0)) > 0)
+			{
+				request.append(buffer, received);
+				while (request.find("\r\n\r\n") != std::string::npos)
+				{
+					request.erase(0, request.find("\r\n\r\n") + 4);
+					std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nok";
+					send(client, response.data(), response.size(), 0);
+					served++;
+				}
+			}
+			close(client);
+		}
+	});
+
+	HttpClient client;
+	auto url = "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/";
+	for (int i = 0; i < requestCount; i++)
+	{
+		auto response = client.Get(url, { "X-Test: 1" }, std::chrono::milliseconds(2000));
+		EXPECT_EQ(200, response._statusCode) << response._error;
+		EXPECT_EQ("ok", response._body);
+		EXPECT_EQ("text/plain", response._contentType);
+	}
+
+	serverThread.join();
+	close(server);
+
+	EXPECT_EQ(1, connections);
+	auto stats = client.GetStats();
+	EXPECT_NE(std::string::npos, stats.find("127.0.0.1: 3 requests, 1 connections")) << stats;
+}
+
+TEST(HttpClient, HostPolicy)
+{
+	// Nothing listens on port 1, connections are refused right away
+	HttpClient client;
+	client.SetHostPolicy(1, 2, std::chrono::seconds(60));
+
+	EXPECT_FALSE(client.Get("http://127.0.0.1:1/", {}, std::chrono::milliseconds(500))._error.empty());
+	EXPECT_FALSE(client.Get("http://127.0.0.1:1/", {}, std::chrono::milliseconds(500))._error.empty());
+
+	auto rejected = client.Get("http://127.0.0.1:1/", {}, std::chrono::milliseconds(500));
+	EXPECT_EQ("Circuit open for 127.0.0.1", rejected._error);
+	EXPECT_EQ(HttpClient::Admission::CircuitOpen, client.Admit("http://127.0.0.1:1/other"));
+	EXPECT_NE(std::string::npos, client.GetStats().find("2 failed, circuit open (retry in ")) << client.GetStats();
+
+	// In-flight limit is per host
+	EXPECT_EQ(HttpClient::Admission::Allowed, client.Admit("http://localhost:1/"));
+	EXPECT_EQ(HttpClient::Admission::Busy, client.Admit("http://localhost:1/"));
+	auto busy = client.Get("http://localhost:1/", {}, std::chrono::milliseconds(50));
+	EXPECT_EQ("Too many requests to localhost", busy._error);
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <utility>
+#include <unordered_map>
+
+#include <curl/curl.h>
+
+#include "circuit_breaker.h"
+
+class HttpResponse
+{
+public:
+	long _statusCode = 0;
+	std::string _body;
+	std::string _error;
+	std::string _contentType;
+	std::chrono::milliseconds _elapsed = {};
+};
+
+/**
+ * HTTP client shared by all handlers.
+ *
+ * Idle easy handles are pooled per host, so a request to a recently used host
+ * goes over its keep-alive connection. DNS answers and TLS sessions are shared
+ * between handles, HTTP/2 is negotiated over TLS where available and compressed
+ * responses are decoded. Connection reuse and latency are tracked per host.
+ *
+ * Every host has a limit on requests in flight and a circuit breaker, so a
+ * host that is down fails fast instead of eating the whole timeout each time.
+ */
+class HttpClient
+{
+public:
+	static constexpr std::chrono::milliseconds defaultTimeout{5000};
+	static constexpr int defaultMaxPerHost = 4;
+	static constexpr int defaultBreakerFailures = 5;
+	static constexpr std::chrono::seconds defaultBreakerOpen{60};
+
+	enum class Admission
+	{
+		Allowed,
+		Busy, // host is at its in-flight limit, try again later
+		CircuitOpen,
+	};
+
+	HttpClient();
+	~HttpClient();
+
+	HttpClient(const HttpClient &) = delete;
+	HttpClient &operator=(const HttpClient &) = delete;
+
+	HttpResponse Get(const std::string &url, const std::vector<std::string> &headers = {},
+					 std::chrono::milliseconds timeout = defaultTimeout);
+	HttpResponse Post(const std::string &url, const std::string &body, const std::vector<std::string> &headers = {},
+					  std::chrono::milliseconds timeout = defaultTimeout);
+
+	void SetHostPolicy(int maxPerHost, int breakerFailures, std::chrono::seconds breakerOpen);
+
+	// For transfers driven elsewhere (MultiFetch): shared options, multi handles keeping their connections,
+	// admission per host. Every allowed transfer must be completed, that frees its slot and updates metrics.
+	void Configure(CURL *handle);
+	CURLM *AcquireMulti();
+	void ReleaseMulti(CURLM *multi);
+	Admission Admit(const std::string &url);
+	void Complete(const std::string &url, CURL *handle, CURLcode result);
+
+	std::string GetStats() const;
+
+	static std::string GetHost(const std::string &url);
+	static std::string UrlEncode(const std::string &input);
+	static std::string FormEncode(const std::vector<std::pair<std::string, std::string>> &fields);
+
+private:
+	HttpResponse perform(const std::string &url, const std::string *postBody,
+						 const std::vector<std::string> &headers, std::chrono::milliseconds timeout);
+	CURL *acquire(const std::string &host);
+	void release(const std::string &host, CURL *handle);
+
+	static void lockShared(CURL *handle, curl_lock_data data, curl_lock_access access, void *client);
+	static void unlockShared(CURL *handle, curl_lock_data data, void *client);
+	static size_t onData(char *data, size_t size, size_t count, void *body);
+
+	class HostStats
+	{
+	public:
+		HostStats(int breakerFailures, std::chrono::seconds breakerOpen)
+			: _breaker(breakerFailures, breakerOpen)
+		{ }
+
+		int _inFlight = 0;
+		CircuitBreaker _breaker;
+
+		long _requests = 0;
+		long _failures = 0;
+		long _rejected = 0;
+		long _newConnections = 0;
+		long _tlsHandshakes = 0;
+		long _http2 = 0;
+		std::chrono::microseconds _totalTime = {};
+		std::chrono::microseconds _maxTime = {};
+	};
+
+	static constexpr size_t maxIdleHandles = 16;
+	static constexpr size_t maxIdleMulti = 4;
+	static constexpr long dnsCacheSeconds = 300;
+	static constexpr long maxRedirects = 5;
+	static constexpr size_t maxHostsInStats = 15;
+
+	CURLSH *_share;
+	std::mutex _shareMutexes[CURL_LOCK_DATA_LAST];
+
+	std::mutex _poolMutex;
+	std::unordered_map<std::string, std::vector<CURL*>> _idle; // by host, most recently used last
+	size_t _idleCount = 0;
+	std::vector<CURLM*> _idleMulti;
+
+	HostStats &getHost(const std::string &host);
+
+	mutable std::mutex _hostsMutex;
+	std::condition_variable _slotFreed;
+	std::map<std::string, HostStats> _hosts;
+	int _maxPerHost = defaultMaxPerHost;
+	int _breakerFailures = defaultBreakerFailures;
+	std::chrono::seconds _breakerOpen = defaultBreakerOpen;
+};
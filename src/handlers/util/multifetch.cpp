@@ -0,0 +1,456 @@
+#include "multifetch.h"
+#include "http_client.h"
+
+#include <thread>
+#include <algorithm>
+#include <cctype>
+
+#include <curl/curl.h>
+#include <glog/logging.h>
+
+class MultiFetch::Transfer
+{
+public:
+	CURL *_handle = nullptr;
+	const FetchRequest *_request = nullptr;
+	FetchResult *_result = nullptr;
+	bool _isTypeChecked = false;
+};
+
+size_t MultiFetch::onData(char *data, size_t size, size_t count, void *transferPtr)
+{
+	auto &transfer = *static_cast<Transfer*>(transferPtr);
+	auto &request = *transfer._request;
+	auto &result = *transfer._result;
+	size *= count;
+
+	// Headers are complete by the time first body bytes arrive
+	if (!transfer._isTypeChecked)
+	{
+		transfer._isTypeChecked = true;
+
+		char *contentType = nullptr;
+		curl_easy_getinfo(transfer._handle, CURLINFO_CONTENT_TYPE, &contentType);
+		result._contentType = contentType ? contentType : "";
+
+		// Media types are case-insensitive, parameters are left as sent
+		auto mediaType = result._contentType.substr(0, result._contentType.find(';'));
+		std::transform(mediaType.begin(), mediaType.end(), mediaType.begin(), [](unsigned char c) { return std::tolower(c); });
+
+		bool accepted = request._contentTypes.empty() || result._contentType.empty();
+		for (const auto &type : request._contentTypes)
+			accepted = accepted || mediaType.compare(0, type.size(), type) == 0;
+
+		if (!accepted)
+		{
+			result._error = "Skipped " + result._contentType;
+			return 0; // aborts the transfer
+		}
+	}
+
+	if (request._maxBytes > 0 && result._bytesReceived + size >= request._maxBytes)
+	{
+		size = request._maxBytes - result._bytesReceived;
+		result._isTruncated = true;
+	}
+	result._bytesReceived += size;
+
+	if (request._onData)
+		result._isTruncated = !request._onData(data, size) || result._isTruncated;
+	else
+		result._body.append(data, size);
+
+	return result._isTruncated ? 0 : size;
+}
+
+static void readTimings(CURL *handle, FetchResult &result)
+{
+	curl_off_t dns = 0, connect = 0, tls = 0, firstByte = 0, total = 0;
+	curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+	curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+	curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+	curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+	curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+
+	// curl reports time points since start, reused connections have zero connect times
+	using std::chrono::microseconds;
+	auto ready = std::max({ dns, connect, tls });
+	result._dnsTime = microseconds(dns);
+	result._connectTime = microseconds(connect > dns ? connect - dns : 0);
+	result._tlsTime = microseconds(tls > connect ? tls - connect : 0);
+	result._firstByteTime = microseconds(firstByte > ready ? firstByte - ready : 0);
+	result._totalTime = microseconds(total);
+
+	long version = 0;
+	curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+	switch (version)
+	{
+	case CURL_HTTP_VERSION_1_0: result._httpVersion = "1.0"; break;
+	case CURL_HTTP_VERSION_1_1: result._httpVersion = "1.1"; break;
+	case CURL_HTTP_VERSION_2_0: result._httpVersion = "2"; break;
+	case 30: result._httpVersion = "3"; break; // CURL_HTTP_VERSION_3, missing in older headers
+	default: result._httpVersion.clear(); break;
+	}
+}
+
+MultiFetch::MultiFetch(std::chrono::milliseconds deadline, HttpClient *client)
+	: _deadline(deadline)
+	, _client(client)
+{
+
+}
+
+void MultiFetch::Run(const std::vector<FetchRequest> &requests,
+					 const std::function<void(size_t, const FetchResult &)> &onResult) const
+{
+	using namespace std::chrono;
+
+	const auto start = steady_clock::now();
+	auto elapsed = [&start] { return duration_cast<milliseconds>(steady_clock::now() - start); };
+
+	std::vector<FetchResult> results(requests.size());
+	std::vector<Transfer> transfers(requests.size());
+	std::vector<bool> finished(requests.size(), false);
+	std::vector<bool> started(requests.size(), false);
+	std::vector<CURL*> handles(requests.size(), nullptr);
+	std::vector<curl_slist*> headers(requests.size(), nullptr);
+	// Request behind each slot, a follow-up replaces the original one
+	std::vector<const FetchRequest*> current(requests.size(), nullptr);
+	std::vector<FetchRequest> followUps(requests.size());
+
+	CURLM *multi = _client ? _client->AcquireMulti() : curl_multi_init();
+	auto prepare = [&](size_t i) {
+		const auto &request = *current[i];
+		results[i] = FetchResult();
+		results[i]._url = request._url;
+		headers[i] = nullptr;
+		for (const auto &header : request._headers)
+			headers[i] = curl_slist_append(headers[i], header.c_str());
+
+		auto handle = handles[i] = curl_easy_init();
+		transfers[i] = { handle, &request, &results[i], false };
+		if (_client)
+			_client->Configure(handle);
+		curl_easy_setopt(handle, CURLOPT_URL, request._url.c_str());
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers[i]);
+		curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(handle, CURLOPT_MAXREDIRS, maxRedirects);
+		curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &MultiFetch::onData);
+		curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfers[i]);
+		curl_easy_setopt(handle, CURLOPT_PRIVATE, reinterpret_cast<char*>(i));
+	};
+
+	auto release = [&](size_t i) {
+		if (started[i])
+			curl_multi_remove_handle(multi, handles[i]);
+		curl_easy_cleanup(handles[i]);
+		curl_slist_free_all(headers[i]);
+		handles[i] = nullptr;
+		headers[i] = nullptr;
+	};
+
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		current[i] = &requests[i];
+		prepare(i);
+	}
+
+	// Requests to a host at its in-flight limit wait here until a slot frees up
+	size_t waiting = 0;
+
+	// Finished slot is restarted with the follow-up request, if its request has one
+	auto finish = [&](size_t i) {
+		finished[i] = true;
+		if (!current[i]->_onFinished)
+			return;
+
+		auto next = current[i]->_onFinished(results[i]);
+		if (!next)
+			return;
+
+		release(i);
+		followUps[i] = std::move(*next);
+		current[i] = &followUps[i];
+		started[i] = false;
+		finished[i] = false;
+		prepare(i);
+		waiting++;
+	};
+
+	auto startAdmitted = [&] {
+		waiting = 0;
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			if (started[i] || finished[i])
+				continue;
+
+			auto admission = _client ? _client->Admit(current[i]->_url) : HttpClient::Admission::Allowed;
+			switch (admission)
+			{
+			case HttpClient::Admission::Allowed:
+				curl_multi_add_handle(multi, handles[i]);
+				started[i] = true;
+				break;
+			case HttpClient::Admission::Busy:
+				waiting++;
+				break;
+			case HttpClient::Admission::CircuitOpen:
+				results[i]._error = "Circuit open for " + HttpClient::GetHost(current[i]->_url);
+				finish(i);
+				break;
+			}
+		}
+	};
+
+	size_t nextToReport = 0;
+	auto reportFinished = [&] {
+		while (nextToReport < requests.size() && finished[nextToReport])
+		{
+			onResult(nextToReport, results[nextToReport]);
+			++nextToReport;
+		}
+	};
+
+	startAdmitted();
+	int running = 0;
+	while (true)
+	{
+		curl_multi_perform(multi, &running);
+
+		int queued = 0;
+		while (auto message = curl_multi_info_read(multi, &queued))
+		{
+			if (message->msg != CURLMSG_DONE)
+				continue;
+
+			char *privateData = nullptr;
+			curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &privateData);
+			auto index = reinterpret_cast<size_t>(privateData);
+
+			auto &result = results[index];
+			curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &result._statusCode);
+			// Transfers stopped on purpose end with a write error
+			bool isStopped = message->data.result == CURLE_WRITE_ERROR && (result._isTruncated || !result._error.empty());
+			if (message->data.result != CURLE_OK && !isStopped)
+				result._error = curl_easy_strerror(message->data.result);
+			result._elapsed = elapsed();
+			readTimings(message->easy_handle, result);
+
+			if (_client)
+				_client->Complete(current[index]->_url, message->easy_handle, isStopped ? CURLE_OK : message->data.result);
+			finish(index);
+		}
+
+		// Slots may also be freed by other threads using the same client
+		if (waiting > 0)
+			startAdmitted();
+
+		reportFinished();
+
+		size_t active = 0;
+		for (size_t i = 0; i < requests.size(); i++)
+			active += started[i] && !finished[i];
+
+		auto remaining = _deadline - elapsed();
+		if ((active == 0 && waiting == 0) || remaining.count() <= 0)
+			break;
+
+		auto wait = static_cast<int>(std::min<long long>(remaining.count(), maxWaitMs));
+		if (active == 0)
+			std::this_thread::sleep_for(milliseconds(std::min(wait, waitingPollMs)));
+		else
+			curl_multi_wait(multi, nullptr, 0, wait, nullptr);
+	}
+
+	for (size_t i = 0; i < requests.size(); i++)
+	{
+		if (!finished[i])
+		{
+			results[i]._isLate = true;
+			results[i]._error = "Deadline exceeded";
+			results[i]._elapsed = elapsed();
+			if (started[i])
+				readTimings(handles[i], results[i]);
+			finished[i] = true;
+			LOG(INFO) << "Fetch of " << current[i]->_url << " didn't finish in " << _deadline.count() << " ms";
+
+			if (_client && started[i])
+				_client->Complete(current[i]->_url, handles[i], CURLE_OPERATION_TIMEDOUT);
+		}
+
+		release(i);
+	}
+	if (_client)
+		_client->ReleaseMulti(multi);
+	else
+		curl_multi_cleanup(multi);
+
+	reportFinished();
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+TEST(MultiFetch, OrderAndDeadline)
+{
+	{
+		std::ofstream("testdb/multifetch_a.html") << "<title>A</title>";
+		std::ofstream("testdb/multifetch_b.html") << "<title>B</title>";
+	}
+
+	// Accepts connections (through backlog) but never answers
+	int silent = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addressLength = sizeof(address);
+	ASSERT_EQ(0, bind(silent, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+	ASSERT_EQ(0, listen(silent, 4));
+	ASSERT_EQ(0, getsockname(silent, reinterpret_cast<sockaddr*>(&address), &addressLength));
+
+	char cwd[4096];
+	ASSERT_NE(nullptr, getcwd(cwd, sizeof(cwd)));
+	std::string prefix = "file://" + std::string(cwd) + "/testdb/";
+
+	std::vector<FetchRequest> requests = {
+		{ prefix + "multifetch_a.html", {} },
+		{ "http://127.0.0.1:" + std::to_string(ntohs(address.sin_port)) + "/", { "Accept-Language: en" } },
+		{ prefix + "multifetch_b.html", {} },
+	};
+
+	std::vector<size_t> order;
+	std::vector<FetchResult> results;
+	auto start = std::chrono::steady_clock::now();
+	MultiFetch(std::chrono::milliseconds(300)).Run(requests, [&](size_t index, const FetchResult &result) {
+		order.push_back(index);
+		results.push_back(result);
+	});
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	close(silent);
+
+	EXPECT_EQ(std::vector<size_t>({ 0, 1, 2 }), order);
+	ASSERT_EQ(3, results.size());
+	EXPECT_EQ("<title>A</title>", results[0]._body);
+	EXPECT_FALSE(results[0]._isLate);
+	EXPECT_TRUE(results[1]._isLate);
+	EXPECT_EQ("<title>B</title>", results[2]._body);
+	EXPECT_LT(results[0]._elapsed.count(), 300);
+	EXPECT_GT(results[0]._totalTime.count(), 0);
+	EXPECT_EQ(0, results[1]._firstByteTime.count());
+
+	// One budget for all requests, not one per request
+	EXPECT_LT(elapsed, std::chrono::milliseconds(1000));
+}
+
+TEST(MultiFetch, Streaming)
+{
+	{
+		std::ofstream("testdb/multifetch_big.html") << "<title>Big</title>" << std::string(1 << 20, 'x');
+	}
+
+	char cwd[4096];
+	ASSERT_NE(nullptr, getcwd(cwd, sizeof(cwd)));
+	std::string url = "file://" + std::string(cwd) + "/testdb/multifetch_big.html";
+
+	std::string received;
+	FetchRequest capped = { url, {}, {}, 1000 };
+	FetchRequest stopped = { url, {}, {}, 0, [&received](const char *data, size_t size) {
+		received.append(data, size);
+		return received.size() < 10;
+	} };
+
+	std::vector<FetchResult> results;
+	MultiFetch(std::chrono::milliseconds(1000)).Run({ capped, stopped }, [&](size_t, const FetchResult &result) {
+		results.push_back(result);
+	});
+
+	ASSERT_EQ(2, results.size());
+	EXPECT_TRUE(results[0]._error.empty()) << results[0]._error;
+	EXPECT_TRUE(results[0]._isTruncated);
+	EXPECT_EQ(1000, results[0]._body.size());
+
+	EXPECT_TRUE(results[1]._error.empty()) << results[1]._error;
+	EXPECT_TRUE(results[1]._isTruncated);
+	EXPECT_TRUE(results[1]._body.empty());
+	EXPECT_LT(results[1]._bytesReceived, 1 << 20);
+	EXPECT_EQ(0, received.find("<title>Big</title>"));
+}
+
+TEST(MultiFetch, FollowUp)
+{
+	{
+		std::ofstream("testdb/multifetch_a.html") << "<title>A</title>";
+		std::ofstream("testdb/multifetch_b.html") << "<title>B</title>";
+	}
+
+	char cwd[4096];
+	ASSERT_NE(nullptr, getcwd(cwd, sizeof(cwd)));
+	std::string prefix = "file://" + std::string(cwd) + "/testdb/";
+
+	// Failed request is replaced by its fallback, order of results stays the same
+	std::string missingError;
+	FetchRequest missing = { prefix + "multifetch_missing.html", {} };
+	missing._onFinished = [&](const FetchResult &result) -> std::optional<FetchRequest> {
+		missingError = result._error;
+		if (result._error.empty())
+			return {};
+		return FetchRequest{ prefix + "multifetch_b.html", {} };
+	};
+
+	std::vector<size_t> order;
+	std::vector<FetchResult> results;
+	MultiFetch(std::chrono::milliseconds(1000)).Run({ missing, { prefix + "multifetch_a.html", {} } }, [&](size_t index, const FetchResult &result) {
+		order.push_back(index);
+		results.push_back(result);
+	});
+
+	EXPECT_FALSE(missingError.empty());
+	EXPECT_EQ(std::vector<size_t>({ 0, 1 }), order);
+	ASSERT_EQ(2, results.size());
+	EXPECT_TRUE(results[0]._error.empty()) << results[0]._error;
+	EXPECT_EQ(prefix + "multifetch_b.html", results[0]._url);
+	EXPECT_EQ("<title>B</title>", results[0]._body);
+	EXPECT_EQ("<title>A</title>", results[1]._body);
+}
+
+TEST(MultiFetch, HostPolicy)
+{
+	{
+		std::ofstream("testdb/multifetch_a.html") << "<title>A</title>";
+	}
+
+	char cwd[4096];
+	ASSERT_NE(nullptr, getcwd(cwd, sizeof(cwd)));
+	std::string url = "file://" + std::string(cwd) + "/testdb/multifetch_a.html";
+
+	// One transfer at a time, the rest wait for their turn
+	HttpClient client;
+	client.SetHostPolicy(1, 1, std::chrono::seconds(60));
+	std::vector<FetchResult> results;
+	MultiFetch(std::chrono::milliseconds(1000), &client).Run({ { url, {} }, { url, {} }, { url, {} } }, [&](size_t, const FetchResult &result) {
+		results.push_back(result);
+	});
+
+	ASSERT_EQ(3, results.size());
+	for (const auto &result : results)
+	{
+		EXPECT_TRUE(result._error.empty()) << result._error;
+		EXPECT_EQ("<title>A</title>", result._body);
+	}
+
+	// Refused connection opens the circuit, next fetch of the host fails without trying
+	std::vector<FetchRequest> refused = { { "http://127.0.0.1:1/", {} } };
+	MultiFetch(std::chrono::milliseconds(1000), &client).Run(refused, [](size_t, const FetchResult &) {});
+	MultiFetch(std::chrono::milliseconds(1000), &client).Run(refused, [&](size_t, const FetchResult &result) {
+		EXPECT_EQ("Circuit open for 127.0.0.1", result._error);
+	});
+}
+
+#endif // LCOV_EXCL_STOP
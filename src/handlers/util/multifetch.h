@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <functional>
+
+class HttpClient;
+class FetchResult;
+
+class FetchRequest
+{
+public:
+	std::string _url;
+	std::vector<std::string> _headers; // "Name: value"
+
+	// Body is dropped unless Content-Type starts with one of these, lowercase (empty - accept any)
+	std::vector<std::string> _contentTypes = {};
+	// Transfer stops after this many body bytes (0 - no limit)
+	size_t _maxBytes = 0;
+	// Receives body chunks instead of _body, returns false when it has enough
+	std::function<bool(const char *data, size_t size)> _onData = {};
+	// Sees the result once the transfer finishes (not when late); a returned request is
+	// fetched in its place within the same run and only its result is reported
+	std::function<std::optional<FetchRequest>(const FetchResult &result)> _onFinished = {};
+};
+
+class FetchResult
+{
+public:
+	std::string _url;
+	long _statusCode = 0;
+	std::string _body;
+	std::string _error;
+	std::string _contentType;
+	size_t _bytesReceived = 0;
+	bool _isTruncated = false; // stopped early by _onData or _maxBytes, not an error
+	bool _isLate = false; // not finished before the deadline
+	std::chrono::milliseconds _elapsed = {};
+
+	// Phases of the last request as curl timed them, zero if the phase didn't happen
+	std::chrono::microseconds _dnsTime = {};
+	std::chrono::microseconds _connectTime = {};
+	std::chrono::microseconds _tlsTime = {};
+	std::chrono::microseconds _firstByteTime = {}; // from request sent (connection ready) to first response byte
+	std::chrono::microseconds _totalTime = {};    // includes redirects
+	std::string _httpVersion; // "1.1", "2", ...
+};
+
+/**
+ * Fetches several URLs at once (curl multi interface) under one overall deadline.
+ *
+ * Results are reported in request order: each one as soon as it and all earlier
+ * requests are finished. Requests still running at the deadline are aborted
+ * and reported with _isLate set. Follow-up requests (_onFinished) share the
+ * deadline and the transfer set with the rest, so they don't hold up other hosts.
+ *
+ * With an HttpClient the transfers use its shared DNS/TLS caches and a multi
+ * handle that keeps connections alive between runs, and are counted in its stats.
+ * Its per-host policy applies too: requests to a busy host start once a slot
+ * is free, requests to a host with an open circuit fail right away.
+ */
+class MultiFetch
+{
+public:
+	explicit MultiFetch(std::chrono::milliseconds deadline, HttpClient *client = nullptr);
+
+	void Run(const std::vector<FetchRequest> &requests,
+			 const std::function<void(size_t index, const FetchResult &result)> &onResult) const;
+
+private:
+	std::chrono::milliseconds _deadline;
+	HttpClient *_client;
+
+	class Transfer;
+	static size_t onData(char *data, size_t size, size_t count, void *transfer);
+
+	static constexpr long maxRedirects = 5;
+	static constexpr int maxWaitMs = 100;
+	static constexpr int waitingPollMs = 10;
+};
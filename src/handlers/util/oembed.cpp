@@ -0,0 +1,166 @@
+#include "oembed.h"
+
+#include <glog/logging.h>
+#include <json/reader.h>
+#include <json/value.h>
+
+#include "http_client.h"
+
+OEmbedProvider::OEmbedProvider(const std::string &name, const std::vector<std::string> &hosts, const std::string &endpoint,
+							   const std::string &titleFormat, const std::string &urlPattern,
+							   const std::vector<std::string> &headers)
+	: _name(name)
+	, _hosts(hosts)
+	, _endpoint(endpoint)
+	, _titleFormat(titleFormat)
+	, _headers(headers)
+{
+	if (!urlPattern.empty())
+		_urlPattern = std::regex(urlPattern, std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+}
+
+std::optional<std::string> OEmbedProvider::GetRequestURL(const std::string &url) const
+{
+	std::smatch match;
+	if (_urlPattern && !std::regex_search(url, match, *_urlPattern))
+		return {};
+
+	std::string request;
+	for (size_t pos = 0; pos < _endpoint.size(); pos++)
+	{
+		if (_endpoint.compare(pos, 5, "{url}") == 0)
+		{
+			request += HttpClient::UrlEncode(url);
+			pos += 4;
+		} else if (_urlPattern && _endpoint[pos] == '$' && pos + 1 < _endpoint.size()
+				   && _endpoint[pos + 1] >= '1' && _endpoint[pos + 1] <= '9') {
+			size_t group = _endpoint[pos + 1] - '0';
+			if (group < match.size())
+				request += HttpClient::UrlEncode(match[group].str());
+			pos++;
+		} else {
+			request += _endpoint[pos];
+		}
+	}
+
+	return request;
+}
+
+std::optional<std::string> OEmbedProvider::ParseTitle(const std::string &json) const
+{
+	Json::Value root;
+	Json::Reader reader;
+	if (!reader.parse(json, root) || !root.isObject())
+	{
+		LOG(INFO) << "Invalid JSON from " << _name;
+		return {};
+	}
+
+	// Text in [...] is dropped when a field inside it is missing
+	std::string title;
+	std::string optional;
+	bool inOptional = false;
+	bool isComplete = true;
+	for (size_t pos = 0; pos < _titleFormat.size(); pos++)
+	{
+		auto &output = inOptional ? optional : title;
+		auto c = _titleFormat[pos];
+		auto close = c == '{' ? _titleFormat.find('}', pos) : std::string::npos;
+		if (close != std::string::npos)
+		{
+			const auto &value = root[_titleFormat.substr(pos + 1, close - pos - 1)];
+			if (value.isString() && !value.asString().empty())
+				output += value.asString();
+			else if (inOptional)
+				isComplete = false;
+			else
+				return {};
+			pos = close;
+		} else if (c == '[' && !inOptional) {
+			inOptional = true;
+			isComplete = true;
+			optional.clear();
+		} else if (c == ']' && inOptional) {
+			inOptional = false;
+			if (isComplete)
+				title += optional;
+		} else {
+			output += c;
+		}
+	}
+
+	if (title.empty())
+		return {};
+
+	return title;
+}
+
+OEmbedProviders::OEmbedProviders()
+{
+	Add({ "YouTube", { "youtube.com", "m.youtube.com", "music.youtube.com", "youtu.be" },
+		  "https://www.youtube.com/oembed?format=json&url={url}" });
+	Add({ "Vimeo", { "vimeo.com", "player.vimeo.com" }, "https://vimeo.com/api/oembed.json?url={url}" });
+	Add({ "SoundCloud", { "soundcloud.com", "m.soundcloud.com" }, "https://soundcloud.com/oembed?format=json&url={url}" });
+	Add({ "Twitter", { "twitter.com", "mobile.twitter.com", "x.com" },
+		  "https://publish.twitter.com/oembed?omit_script=true&url={url}", "Post by {author_name}" });
+	Add({ "Reddit", { "reddit.com", "old.reddit.com" }, "https://www.reddit.com/oembed?url={url}" });
+	Add({ "Spotify", { "open.spotify.com" }, "https://open.spotify.com/oembed?url={url}" });
+	Add({ "TikTok", { "tiktok.com" }, "https://www.tiktok.com/oembed?url={url}" });
+	Add({ "Flickr", { "flickr.com", "flic.kr" }, "https://www.flickr.com/services/oembed/?format=json&url={url}" });
+	Add({ "GitHub", { "github.com" }, "https://api.github.com/repos/$1/$2", "{full_name}[: {description}]",
+		  "^https?://(?:www\\.)?github\\.com/([\\w.-]+)/([\\w.-]+?)(?:\\.git)?/?(?:[?#].*)?$",
+		  { "User-Agent: lemongrab", "Accept: application/vnd.github+json" } });
+}
+
+void OEmbedProviders::Add(const OEmbedProvider &provider)
+{
+	_providers.push_back(provider);
+	for (const auto &host : provider._hosts)
+		_byHost[host] = _providers.size() - 1;
+}
+
+const OEmbedProvider *OEmbedProviders::Find(const std::string &hostname) const
+{
+	auto provider = _byHost.find(hostname);
+	if (provider == _byHost.end())
+		return nullptr;
+
+	return &_providers[provider->second];
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(OEmbed, Providers)
+{
+	OEmbedProviders providers;
+	EXPECT_EQ(nullptr, providers.Find("example.com"));
+
+	auto youtube = providers.Find("youtu.be");
+	ASSERT_NE(nullptr, youtube);
+	EXPECT_EQ("https://www.youtube.com/oembed?format=json&url=https%3A%2F%2Fyoutu.be%2Fabc%3Ft%3D1",
+			  youtube->GetRequestURL("https://youtu.be/abc?t=1").value_or(""));
+	EXPECT_EQ("Song", youtube->ParseTitle("{\"title\": \"Song\", \"author_name\": \"Band\"}").value_or(""));
+	EXPECT_FALSE(youtube->ParseTitle("{\"author_name\": \"Band\"}").has_value());
+	EXPECT_FALSE(youtube->ParseTitle("<html>").has_value());
+
+	auto twitter = providers.Find("x.com");
+	ASSERT_NE(nullptr, twitter);
+	EXPECT_EQ("Post by Someone", twitter->ParseTitle("{\"author_name\": \"Someone\", \"html\": \"...\"}").value_or(""));
+
+	auto github = providers.Find("github.com");
+	ASSERT_NE(nullptr, github);
+	EXPECT_EQ("https://api.github.com/repos/kremius/lemongrab", github->GetRequestURL("https://github.com/kremius/lemongrab").value_or(""));
+	EXPECT_EQ("https://api.github.com/repos/a/b.c", github->GetRequestURL("https://www.github.com/a/b.c.git/").value_or(""));
+	EXPECT_FALSE(github->GetRequestURL("https://github.com/a/b/issues/1").has_value());
+	EXPECT_EQ("a/b: Bot", github->ParseTitle("{\"full_name\": \"a/b\", \"description\": \"Bot\"}").value_or(""));
+	EXPECT_EQ("a/b", github->ParseTitle("{\"full_name\": \"a/b\", \"description\": null}").value_or(""));
+	EXPECT_EQ("a/b", github->ParseTitle("{\"full_name\": \"a/b\", \"description\": \"\"}").value_or(""));
+	EXPECT_FALSE(github->ParseTitle("{\"description\": \"Bot\"}").has_value());
+
+	providers.Add({ "Custom", { "youtu.be" }, "https://example.com/oembed?url={url}" });
+	EXPECT_EQ("Custom", providers.Find("youtu.be")->_name);
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * Lightweight title endpoint of a site (oEmbed or a plain JSON API).
+ *
+ * _endpoint gets {url} replaced with the encoded page URL and $1..$9 with
+ * groups of urlPattern. _titleFormat gets {field} replaced with string fields
+ * of the JSON response; a missing or empty field means no title, unless it is
+ * inside an optional "[...]" part, which is then left out.
+ */
+class OEmbedProvider
+{
+public:
+	OEmbedProvider(const std::string &name, const std::vector<std::string> &hosts, const std::string &endpoint,
+				   const std::string &titleFormat = "{title}", const std::string &urlPattern = "",
+				   const std::vector<std::string> &headers = {});
+
+	// Endpoint for the page, none if the provider doesn't handle this URL
+	std::optional<std::string> GetRequestURL(const std::string &url) const;
+	std::optional<std::string> ParseTitle(const std::string &json) const;
+
+	std::string _name;
+	std::vector<std::string> _hosts; // as findURLs reports them, without "www."
+	std::string _endpoint;
+	std::string _titleFormat;
+	std::vector<std::string> _headers;
+
+private:
+	std::optional<std::regex> _urlPattern;
+};
+
+class OEmbedProviders
+{
+public:
+	// Starts with the built-in table
+	OEmbedProviders();
+
+	void Add(const OEmbedProvider &provider);
+	const OEmbedProvider *Find(const std::string &hostname) const;
+
+private:
+	std::vector<OEmbedProvider> _providers;
+	std::unordered_map<std::string, size_t> _byHost;
+};
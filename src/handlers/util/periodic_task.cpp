@@ -0,0 +1,52 @@
+#include "periodic_task.h"
+
+#include "thread_util.h"
+
+PeriodicTask::PeriodicTask(const std::string &name, std::chrono::seconds interval, std::function<void()> task, bool runImmediately)
+	: _interval(interval)
+	, _task(std::move(task))
+	, _runImmediately(runImmediately)
+{
+	_thread = std::thread(&PeriodicTask::Run, this);
+	nameThread(_thread, name);
+}
+
+PeriodicTask::~PeriodicTask()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_isRunning = false;
+	}
+
+	_wakeup.notify_all();
+	_thread.join();
+}
+
+void PeriodicTask::Trigger()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_isTriggered = true;
+	}
+
+	_wakeup.notify_all();
+}
+
+void PeriodicTask::Run()
+{
+	auto isWoken = [this] { return !_isRunning || _isTriggered; };
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (!_runImmediately)
+		_wakeup.wait_for(lock, _interval, isWoken);
+
+	while (_isRunning)
+	{
+		_isTriggered = false;
+		lock.unlock();
+		_task();
+		lock.lock();
+
+		_wakeup.wait_for(lock, _interval, isWoken);
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <string>
+
+/**
+ * Runs task on a named background thread every interval, starting right away
+ * or (with runImmediately off) after the first interval.
+ * Trigger() runs it early, the next run is one interval after that.
+ * Destructor wakes the thread up and waits for the current run to finish.
+ */
+class PeriodicTask
+{
+public:
+	PeriodicTask(const std::string &name, std::chrono::seconds interval, std::function<void()> task, bool runImmediately = true);
+	~PeriodicTask();
+
+	PeriodicTask(const PeriodicTask &) = delete;
+	PeriodicTask &operator=(const PeriodicTask &) = delete;
+
+	// Wakes the thread up for a run now, or right after the current one
+	void Trigger();
+
+private:
+	void Run();
+
+	std::chrono::seconds _interval;
+	std::function<void()> _task;
+	bool _runImmediately;
+
+	std::mutex _mutex;
+	std::condition_variable _wakeup;
+	bool _isRunning = true;
+	bool _isTriggered = false;
+	std::thread _thread;
+};
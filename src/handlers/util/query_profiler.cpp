@@ -0,0 +1,218 @@
+#include "query_profiler.h"
+
+#include <algorithm>
+
+#include <sqlite3.h>
+#include <glog/logging.h>
+
+#include "sqlite_connection.h"
+
+static int profileCallback(unsigned type, void *context, void *statement, void *elapsed)
+{
+	if (type != SQLITE_TRACE_PROFILE)
+		return 0;
+
+	auto sql = sqlite3_sql(static_cast<sqlite3_stmt*>(statement));
+	if (sql)
+		static_cast<QueryProfiler*>(context)->Record(sql, std::chrono::nanoseconds(*static_cast<sqlite3_int64*>(elapsed)));
+
+	return 0;
+}
+
+QueryProfiler::QueryProfiler(const std::string &path, std::chrono::milliseconds threshold, size_t topN)
+	: _path(path)
+	, _threshold(threshold)
+	, _topN(std::max<size_t>(topN, 1))
+{
+
+}
+
+QueryProfiler::~QueryProfiler() = default;
+
+void QueryProfiler::Attach(sqlite3 *db)
+{
+	sqlite3_trace_v2(db, SQLITE_TRACE_PROFILE, &profileCallback, this);
+}
+
+void QueryProfiler::Record(const std::string &sql, std::chrono::nanoseconds elapsed)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	++_statements;
+
+	if (elapsed < _threshold)
+		return;
+
+	auto existing = _slowQueries.find(sql);
+	if (existing == _slowQueries.end())
+	{
+		// Table is full: new query has to beat the fastest one to get in
+		if (_slowQueries.size() >= _topN)
+		{
+			auto fastest = std::min_element(_slowQueries.begin(), _slowQueries.end(), [](const auto &a, const auto &b) {
+				return a.second._max < b.second._max;
+			});
+			if (fastest->second._max >= elapsed)
+				return;
+			_slowQueries.erase(fastest);
+		}
+
+		// Runs inside the statement, so the plan is left for the report
+		existing = _slowQueries.emplace(sql, SlowQuery{sql}).first;
+		LOG(WARNING) << "Slow query in " << _path << " ("
+					 << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms): " << sql;
+	}
+
+	auto &query = existing->second;
+	query._calls++;
+	query._total += elapsed;
+	query._max = std::max(query._max, elapsed);
+}
+
+std::vector<QueryProfiler::SlowQuery> QueryProfiler::GetSlowQueries() const
+{
+	std::vector<SlowQuery> result;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (const auto &query : _slowQueries)
+			result.push_back(query.second);
+	}
+
+	std::sort(result.begin(), result.end(), [](const SlowQuery &a, const SlowQuery &b) {
+		return a._max > b._max;
+	});
+	return result;
+}
+
+long long QueryProfiler::GetStatementCount() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _statements;
+}
+
+std::string QueryProfiler::Report()
+{
+	using std::chrono::duration_cast;
+	using std::chrono::milliseconds;
+
+	ExplainSlowQueries();
+	auto slowQueries = GetSlowQueries();
+	std::string report = _path + ": " + std::to_string(GetStatementCount()) + " statements, "
+			+ std::to_string(slowQueries.size()) + " slow (over " + std::to_string(_threshold.count()) + " ms)";
+
+	for (const auto &query : slowQueries)
+	{
+		auto sql = query._sql.size() > maxReportedSQL ? query._sql.substr(0, maxReportedSQL) + "..." : query._sql;
+		report += "\n  max " + std::to_string(duration_cast<milliseconds>(query._max).count()) + " ms, avg "
+				+ std::to_string(duration_cast<milliseconds>(query._total / query._calls).count()) + " ms, "
+				+ std::to_string(query._calls) + " calls: " + sql;
+
+		if (!query._plan.empty())
+			report += " [" + query._plan + "]";
+	}
+
+	return report;
+}
+
+void QueryProfiler::ExplainSlowQueries()
+{
+	std::vector<std::string> pending;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (const auto &query : _slowQueries)
+		{
+			if (query.second._plan.empty())
+				pending.push_back(query.first);
+		}
+	}
+
+	// Profiled connections keep running while plans are looked up
+	std::vector<std::pair<std::string, std::string>> plans;
+	{
+		std::lock_guard<std::mutex> lock(_explainMutex);
+		for (const auto &sql : pending)
+			plans.emplace_back(sql, Explain(sql));
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto &plan : plans)
+	{
+		auto query = _slowQueries.find(plan.first);
+		if (query != _slowQueries.end())
+			query->second._plan = plan.second;
+	}
+}
+
+std::string QueryProfiler::Explain(const std::string &sql)
+{
+	// Another connection to an in-memory database would see an empty one
+	if (_path == ":memory:")
+		return "";
+
+	if (!_explainConnection)
+		_explainConnection = std::make_unique<SQLiteConnection>(_path, true);
+
+	// Plan is looked up on its own connection, this one isn't traced
+	std::string plan;
+	_explainConnection->Query("EXPLAIN QUERY PLAN " + sql, [&](const std::vector<std::string> &row) {
+		if (row.size() < 4)
+			return;
+		if (!plan.empty())
+			plan += "; ";
+		plan += row[3];
+	});
+
+	return plan;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+TEST(QueryProfiler, CapturesPlan)
+{
+	const std::string path = "testdb/query_profiler_test.db";
+	std::remove(path.c_str());
+
+	SQLiteConnection db(path);
+	ASSERT_TRUE(db.Execute("CREATE TABLE test (id INTEGER PRIMARY KEY, payload TEXT);"
+						   "INSERT INTO test (payload) VALUES ('a'), ('bxb'), ('c');"));
+
+	QueryProfiler profiler(path, std::chrono::milliseconds(0), 2);
+	profiler.Attach(db.GetHandle());
+
+	ASSERT_TRUE(db.Execute("SELECT * FROM test WHERE payload LIKE '%x%'"));
+	ASSERT_TRUE(db.Execute("SELECT * FROM test WHERE payload LIKE '%x%'"));
+	ASSERT_TRUE(db.Execute("SELECT * FROM test WHERE id = 2"));
+	ASSERT_TRUE(db.Execute("SELECT count(*) FROM test"));
+
+	EXPECT_EQ(4, profiler.GetStatementCount());
+
+	auto slowQueries = profiler.GetSlowQueries();
+	ASSERT_GE(2, slowQueries.size());
+	ASSERT_FALSE(slowQueries.empty());
+	for (const auto &query : slowQueries)
+		EXPECT_TRUE(query._plan.empty());
+
+	// Plans are only looked up for reports
+	profiler.ExplainSlowQueries();
+	slowQueries = profiler.GetSlowQueries();
+
+	for (const auto &query : slowQueries)
+	{
+		if (query._sql.find("LIKE") != std::string::npos)
+		{
+			EXPECT_EQ(2, query._calls);
+			EXPECT_NE(std::string::npos, query._plan.find("SCAN"));
+		}
+		if (query._sql.find("id = 2") != std::string::npos)
+		{
+			EXPECT_NE(std::string::npos, query._plan.find("INTEGER PRIMARY KEY"));
+		}
+	}
+
+	EXPECT_NE(std::string::npos, profiler.Report().find("4 statements"));
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+struct sqlite3;
+class SQLiteConnection;
+
+/**
+ * Times every statement run on attached connections (sqlite3_trace_v2 profile events).
+ *
+ * Statements slower than threshold are grouped by their SQL text (parameters are
+ * not expanded) and written to the log. Only topN slowest are kept.
+ * EXPLAIN QUERY PLAN for them runs when a report is asked for, on a separate
+ * read-only connection to path, never from the trace callback.
+ */
+class QueryProfiler
+{
+public:
+	struct SlowQuery
+	{
+		std::string _sql;
+		std::string _plan;
+		int _calls = 0;
+		std::chrono::nanoseconds _total = {};
+		std::chrono::nanoseconds _max = {};
+	};
+
+	QueryProfiler(const std::string &path, std::chrono::milliseconds threshold, size_t topN);
+	~QueryProfiler();
+
+	void Attach(sqlite3 *db);
+	void Record(const std::string &sql, std::chrono::nanoseconds elapsed);
+
+	// Slowest first
+	std::vector<SlowQuery> GetSlowQueries() const;
+	long long GetStatementCount() const;
+	// Captures missing plans first
+	std::string Report();
+
+	// Looks up plans of slow queries that don't have one yet
+	void ExplainSlowQueries();
+
+private:
+	std::string Explain(const std::string &sql);
+
+	std::string _path;
+	std::chrono::milliseconds _threshold;
+	size_t _topN;
+
+	mutable std::mutex _mutex;
+	long long _statements = 0;
+	std::unordered_map<std::string, SlowQuery> _slowQueries;
+
+	std::mutex _explainMutex;
+	std::unique_ptr<SQLiteConnection> _explainConnection;
+
+	static constexpr size_t maxReportedSQL = 200;
+};
@@ -0,0 +1,110 @@
+#include "recent_links.h"
+
+#include <algorithm>
+
+RecentLinks::RecentLinks(size_t capacity, std::chrono::seconds window)
+	: _capacity(std::max<size_t>(capacity, 1))
+	, _window(window)
+{
+
+}
+
+bool RecentLinks::Add(const std::string &key, const std::string &poster, Clock::time_point postedAt)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	expire(postedAt);
+
+	auto existing = _postings.find(key);
+	if (existing != _postings.end())
+		return false;
+
+	_postings[key] = { poster, postedAt };
+	_order.emplace_back(postedAt, key);
+
+	while (_postings.size() > _capacity && !_order.empty())
+	{
+		_postings.erase(_order.front().second);
+		_order.pop_front();
+	}
+
+	return true;
+}
+
+std::optional<RecentLinks::Posting> RecentLinks::Find(const std::string &key, Clock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	expire(now);
+
+	auto posting = _postings.find(key);
+	if (posting == _postings.end())
+		return {};
+
+	return posting->second;
+}
+
+size_t RecentLinks::Size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _postings.size();
+}
+
+std::chrono::seconds RecentLinks::GetWindow() const
+{
+	return _window;
+}
+
+std::string RecentLinks::FormatAge(Clock::duration age)
+{
+	auto seconds = std::max<long>(std::chrono::duration_cast<std::chrono::seconds>(age).count(), 0);
+	if (seconds < 60)
+		return std::to_string(seconds) + "s";
+	if (seconds < 60 * 60)
+		return std::to_string(seconds / 60) + "m";
+	if (seconds < 24 * 60 * 60)
+		return std::to_string(seconds / (60 * 60)) + "h";
+	return std::to_string(seconds / (24 * 60 * 60)) + "d";
+}
+
+void RecentLinks::expire(Clock::time_point now)
+{
+	while (!_order.empty() && _order.front().first + _window <= now)
+	{
+		_postings.erase(_order.front().second);
+		_order.pop_front();
+	}
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(RecentLinks, WindowAndCapacity)
+{
+	RecentLinks links(2, std::chrono::seconds(600));
+	auto start = RecentLinks::Clock::from_time_t(1000);
+
+	EXPECT_TRUE(links.Add("a", "Bob", start));
+	EXPECT_FALSE(links.Add("a", "Alice", start + std::chrono::seconds(60)));
+
+	auto posting = links.Find("a", start + std::chrono::seconds(120));
+	ASSERT_TRUE(posting.has_value());
+	EXPECT_EQ("Bob", posting->_poster);
+	EXPECT_EQ(start, posting->_postedAt);
+
+	// Window counts from the first posting
+	EXPECT_FALSE(links.Find("a", start + std::chrono::seconds(600)).has_value());
+	EXPECT_TRUE(links.Add("a", "Alice", start + std::chrono::seconds(700)));
+	EXPECT_EQ("Alice", links.Find("a", start + std::chrono::seconds(701))->_poster);
+
+	EXPECT_TRUE(links.Add("b", "Bob", start + std::chrono::seconds(710)));
+	EXPECT_TRUE(links.Add("c", "Bob", start + std::chrono::seconds(720)));
+	EXPECT_EQ(2, links.Size());
+	EXPECT_FALSE(links.Find("a", start + std::chrono::seconds(730)).has_value());
+
+	EXPECT_EQ("45s", RecentLinks::FormatAge(std::chrono::seconds(45)));
+	EXPECT_EQ("12m", RecentLinks::FormatAge(std::chrono::seconds(12 * 60 + 30)));
+	EXPECT_EQ("3h", RecentLinks::FormatAge(std::chrono::hours(3)));
+	EXPECT_EQ("2d", RecentLinks::FormatAge(std::chrono::hours(50)));
+}
+
+#endif // LCOV_EXCL_STOP
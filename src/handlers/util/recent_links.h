@@ -0,0 +1,50 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * Recently posted links by canonical URL, for "already posted" answers.
+ *
+ * Only the first posting inside the window is remembered, later reposts don't
+ * extend it. Postings are expected in time order; the oldest ones are dropped
+ * once they leave the window or the index grows over capacity.
+ */
+class RecentLinks
+{
+public:
+	using Clock = std::chrono::system_clock;
+
+	class Posting
+	{
+	public:
+		std::string _poster;
+		Clock::time_point _postedAt;
+	};
+
+	RecentLinks(size_t capacity, std::chrono::seconds window);
+
+	// False if the link was already posted inside the window
+	bool Add(const std::string &key, const std::string &poster, Clock::time_point postedAt = Clock::now());
+	std::optional<Posting> Find(const std::string &key, Clock::time_point now = Clock::now());
+
+	size_t Size() const;
+	std::chrono::seconds GetWindow() const;
+
+	// "45s", "12m", "3h", "2d"
+	static std::string FormatAge(Clock::duration age);
+
+private:
+	void expire(Clock::time_point now);
+
+	size_t _capacity;
+	std::chrono::seconds _window;
+
+	mutable std::mutex _mutex;
+	std::unordered_map<std::string, Posting> _postings;
+	std::deque<std::pair<Clock::time_point, std::string>> _order; // oldest first
+};
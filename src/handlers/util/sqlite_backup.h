@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+
+/**
+ * @brief Online backup of a live database using sqlite backup API
+ *
+ * Pages are copied in small steps with a pause in between. The whole copy runs
+ * inside one read transaction, so with WAL journal writers are never blocked
+ * and the snapshot doesn't restart when the source changes.
+ * Snapshot is written to a temporary file and renamed over destination when complete.
+ */
+bool BackupDatabase(const std::string &source,
+					const std::string &destination,
+					int pagesPerStep = 64,
+					std::chrono::milliseconds pause = std::chrono::milliseconds(5));
@@ -0,0 +1,112 @@
+#include "sqlite_connection.h"
+
+#include <sqlite3.h>
+#include <glog/logging.h>
+
+SQLiteConnection::SQLiteConnection(const std::string &path, bool readOnly)
+	: _path(path)
+{
+	int flags = readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+	if (sqlite3_open_v2(path.c_str(), &_db, flags, nullptr) != SQLITE_OK)
+	{
+		LOG(ERROR) << "Can't open database " << path << ": " << (_db ? sqlite3_errmsg(_db) : "out of memory");
+		sqlite3_close(_db);
+		_db = nullptr;
+		return;
+	}
+
+	sqlite3_busy_timeout(_db, busyTimeoutMs);
+}
+
+SQLiteConnection::~SQLiteConnection()
+{
+	if (_db)
+		sqlite3_close(_db);
+}
+
+bool SQLiteConnection::IsOpen() const
+{
+	return _db != nullptr;
+}
+
+sqlite3 *SQLiteConnection::GetHandle() const
+{
+	return _db;
+}
+
+const std::string &SQLiteConnection::GetPath() const
+{
+	return _path;
+}
+
+bool SQLiteConnection::Execute(const std::string &sql)
+{
+	if (!_db)
+		return false;
+
+	char *error = nullptr;
+	if (sqlite3_exec(_db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+	{
+		LOG(ERROR) << "SQL error in " << _path << ": " << (error ? error : "unknown") << " | " << sql;
+		sqlite3_free(error);
+		return false;
+	}
+
+	return true;
+}
+
+bool SQLiteConnection::Query(const std::string &sql, const std::function<void(const std::vector<std::string> &)> &onRow)
+{
+	if (!_db)
+		return false;
+
+	sqlite3_stmt *statement = nullptr;
+	if (sqlite3_prepare_v2(_db, sql.c_str(), -1, &statement, nullptr) != SQLITE_OK)
+	{
+		LOG(ERROR) << "SQL error in " << _path << ": " << sqlite3_errmsg(_db) << " | " << sql;
+		return false;
+	}
+
+	std::vector<std::string> row(sqlite3_column_count(statement));
+
+	int result;
+	while ((result = sqlite3_step(statement)) == SQLITE_ROW)
+	{
+		for (int column = 0; column < static_cast<int>(row.size()); column++)
+		{
+			auto text = sqlite3_column_text(statement, column);
+			row[column] = text ? reinterpret_cast<const char*>(text) : "";
+		}
+
+		onRow(row);
+	}
+
+	if (result != SQLITE_DONE)
+		LOG(ERROR) << "SQL error in " << _path << ": " << sqlite3_errmsg(_db) << " | " << sql;
+
+	sqlite3_finalize(statement);
+	return result == SQLITE_DONE;
+}
+
+std::optional<long long> SQLiteConnection::QueryInt(const std::string &sql)
+{
+	if (!_db)
+		return {};
+
+	sqlite3_stmt *statement = nullptr;
+	if (sqlite3_prepare_v2(_db, sql.c_str(), -1, &statement, nullptr) != SQLITE_OK)
+	{
+		LOG(ERROR) << "SQL error in " << _path << ": " << sqlite3_errmsg(_db) << " | " << sql;
+		return {};
+	}
+
+	std::optional<long long> value;
+	if (sqlite3_step(statement) == SQLITE_ROW
+			&& sqlite3_column_type(statement, 0) != SQLITE_NULL)
+	{
+		value = sqlite3_column_int64(statement, 0);
+	}
+
+	sqlite3_finalize(statement);
+	return value;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+
+struct sqlite3;
+
+/**
+ * Plain sqlite connection for maintenance work sqlite_orm can't express
+ * (pragmas, raw migrations, etc). Opens its own handle to the database file.
+ */
+class SQLiteConnection
+{
+public:
+	explicit SQLiteConnection(const std::string &path, bool readOnly = false);
+	~SQLiteConnection();
+
+	SQLiteConnection(const SQLiteConnection &) = delete;
+	SQLiteConnection &operator=(const SQLiteConnection &) = delete;
+
+	bool IsOpen() const;
+	sqlite3 *GetHandle() const;
+	const std::string &GetPath() const;
+
+	/**
+	 * @brief Execute one or more statements, results are discarded
+	 */
+	bool Execute(const std::string &sql);
+
+	/**
+	 * @brief Execute single statement and call onRow for every result row (NULLs are empty strings)
+	 */
+	bool Query(const std::string &sql, const std::function<void(const std::vector<std::string> &row)> &onRow);
+
+	std::optional<long long> QueryInt(const std::string &sql);
+
+private:
+	sqlite3 *_db = nullptr;
+	std::string _path;
+
+	static constexpr int busyTimeoutMs = 5000;
+};
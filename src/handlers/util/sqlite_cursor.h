@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+#include "sqlite_db.h"
+
+/**
+ * Lazy cursor over all rows of table T.
+ *
+ * Rows are stepped one by one from a single prepared statement (in rowid order)
+ * instead of being collected into a container first, so the caller can stop
+ * as soon as it has what it needs.
+ */
+template <class T>
+class RowCursor
+{
+public:
+	explicit RowCursor(Storage &storage)
+		: _storage(storage)
+	{
+
+	}
+
+	// Calls visitor for every row until it returns false, returns number of visited rows
+	template <class Visitor>
+	size_t ForEach(Visitor &&visitor)
+	{
+		size_t visited = 0;
+		for (const auto &row : _storage.iterate<T>())
+		{
+			++visited;
+			if (!visitor(row))
+				break;
+		}
+		return visited;
+	}
+
+private:
+	Storage &_storage;
+};
@@ -20,14 +20,59 @@ namespace DB
 		bool blacklist = true;
 	};
 
-	class LoggedURL
+	class CatalogURL
 	{
 	public:
 		int id = -1;
 		std::string URL = "";
 		std::string title = "";
-		long timestamp = 0;
 		std::string fullText = "";
+		long firstSeen = 0;
+		long lastSeen = 0;
+		int postCount = 0;
+		std::string canonical = ""; // URLCanonicalizer key, URL keeps the first posted form
+	};
+
+	class URLOccurrence
+	{
+	public:
+		int id = -1;
+		int urlID = -1;
+		long timestamp = 0;
+		std::string poster = "";
+	};
+
+	class URLArchiveBlock
+	{
+	public:
+		int id = -1;
+		std::string month = "";
+		long offset = 0;
+		long length = 0;
+		long rawLength = 0;
+		long firstTime = 0;
+		long lastTime = 0;
+		int rows = 0;
+	};
+
+	// One URL preview fetch (or title cache hit), phase times in ms
+	class URLFetch
+	{
+	public:
+		int id = -1;
+		long timestamp = 0;
+		std::string host = "";
+		int status = 0;
+		bool failed = false;
+		bool cacheHit = false;
+		int dnsMs = 0;
+		int connectMs = 0;
+		int tlsMs = 0;
+		int firstByteMs = 0;
+		int totalMs = 0;
+		long bytes = 0;
+		std::string contentType = "";
+		std::string httpVersion = "";
 	};
 
 	class Quote
@@ -73,6 +118,23 @@ namespace DB
 		int timepoint_status = 0;
 		int timepoint_message = 0;
 	};
+
+	class SeenCounter
+	{
+	public:
+		std::string name = "";
+		long long value = 0;
+	};
+
+	// Distinct users per time bucket ("d<day>" or "w<week>" since epoch)
+	class SeenRollup
+	{
+	public:
+		std::string bucket = "";
+		int seen = 0;
+		int active = 0;
+		int newUsers = 0;
+	};
 }
 
 inline auto initStorage(const std::string &path)
@@ -97,15 +159,59 @@ inline auto initStorage(const std::string &path)
 								   make_column("rule", &DB::URLRule::rule),
 								   make_column("blacklist", &DB::URLRule::blacklist)
 								   ),
-						make_table("url_log",
+						make_table("url_catalog",
+								   make_column("id",
+											   &DB::CatalogURL::id,
+											   autoincrement(),
+											   primary_key()),
+								   make_column("URL", &DB::CatalogURL::URL, unique()),
+								   make_column("title", &DB::CatalogURL::title),
+								   make_column("fulltext", &DB::CatalogURL::fullText),
+								   make_column("first_seen", &DB::CatalogURL::firstSeen),
+								   make_column("last_seen", &DB::CatalogURL::lastSeen),
+								   make_column("posts", &DB::CatalogURL::postCount),
+								   make_column("canonical", &DB::CatalogURL::canonical, default_value(""))
+								   ),
+						make_table("url_occurrences",
 								   make_column("id",
-											   &DB::LoggedURL::id,
+											   &DB::URLOccurrence::id,
 											   autoincrement(),
 											   primary_key()),
-								   make_column("URL", &DB::LoggedURL::URL),
-								   make_column("title", &DB::LoggedURL::title),
-								   make_column("time", &DB::LoggedURL::timestamp),
-								   make_column("fulltext", &DB::LoggedURL::fullText)
+								   make_column("url_id", &DB::URLOccurrence::urlID),
+								   make_column("time", &DB::URLOccurrence::timestamp),
+								   make_column("poster", &DB::URLOccurrence::poster)
+								   ),
+						make_table("url_archive_blocks",
+								   make_column("id",
+											   &DB::URLArchiveBlock::id,
+											   autoincrement(),
+											   primary_key()),
+								   make_column("month", &DB::URLArchiveBlock::month),
+								   make_column("offset", &DB::URLArchiveBlock::offset),
+								   make_column("length", &DB::URLArchiveBlock::length),
+								   make_column("raw_length", &DB::URLArchiveBlock::rawLength),
+								   make_column("first_time", &DB::URLArchiveBlock::firstTime),
+								   make_column("last_time", &DB::URLArchiveBlock::lastTime),
+								   make_column("rows", &DB::URLArchiveBlock::rows)
+								   ),
+						make_table("url_fetches",
+								   make_column("id",
+											   &DB::URLFetch::id,
+											   autoincrement(),
+											   primary_key()),
+								   make_column("time", &DB::URLFetch::timestamp),
+								   make_column("host", &DB::URLFetch::host),
+								   make_column("status", &DB::URLFetch::status),
+								   make_column("failed", &DB::URLFetch::failed),
+								   make_column("cache_hit", &DB::URLFetch::cacheHit),
+								   make_column("dns_ms", &DB::URLFetch::dnsMs),
+								   make_column("connect_ms", &DB::URLFetch::connectMs),
+								   make_column("tls_ms", &DB::URLFetch::tlsMs),
+								   make_column("first_byte_ms", &DB::URLFetch::firstByteMs),
+								   make_column("total_ms", &DB::URLFetch::totalMs),
+								   make_column("bytes", &DB::URLFetch::bytes),
+								   make_column("content_type", &DB::URLFetch::contentType),
+								   make_column("http_version", &DB::URLFetch::httpVersion)
 								   ),
 						make_table("quotes",
 								   make_column("id", &DB::Quote::id, autoincrement(), primary_key()),
@@ -138,6 +244,16 @@ inline auto initStorage(const std::string &path)
 								   make_column("message", &DB::UserActivity::message),
 								   make_column("timepoint_status", &DB::UserActivity::timepoint_status),
 								   make_column("timepoint_message", &DB::UserActivity::timepoint_message)
+								   ),
+						make_table("seen_counters",
+								   make_column("name", &DB::SeenCounter::name, primary_key()),
+								   make_column("value", &DB::SeenCounter::value)
+								   ),
+						make_table("seen_rollups",
+								   make_column("bucket", &DB::SeenRollup::bucket, primary_key()),
+								   make_column("seen", &DB::SeenRollup::seen),
+								   make_column("active", &DB::SeenRollup::active),
+								   make_column("new_users", &DB::SeenRollup::newUsers)
 								   )
 						);
 }
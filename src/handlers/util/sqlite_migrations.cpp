@@ -0,0 +1,189 @@
+#include "sqlite_migrations.h"
+
+#include <glog/logging.h>
+
+#include "sqlite_connection.h"
+
+// Forward-only, every migration runs in its own transaction.
+// Statements should tolerate databases created from scratch by sync_schema
+static const std::vector<Migration> migrations = {
+	{ 1, "Versioned schema", { } },
+	{ 2, "Deduplicated URL catalog", {
+		  "CREATE TABLE IF NOT EXISTS url_log (id INTEGER PRIMARY KEY AUTOINCREMENT, URL TEXT, title TEXT, time INTEGER, fulltext TEXT)",
+		  "CREATE INDEX IF NOT EXISTS url_log_URL ON url_log(URL, id)",
+		  "INSERT OR IGNORE INTO url_catalog (URL, title, fulltext, first_seen, last_seen, posts) "
+		  "SELECT URL, title, URL || ' ' || title, first_seen, last_seen, posts FROM ("
+		  "  SELECT l.URL AS URL,"
+		  "    coalesce((SELECT t.title FROM url_log t WHERE t.URL = l.URL AND t.title != '' ORDER BY t.id DESC LIMIT 1), '') AS title,"
+		  "    min(l.time) AS first_seen, max(l.time) AS last_seen, count(*) AS posts"
+		  "  FROM url_log l GROUP BY l.URL) ORDER BY first_seen",
+		  "INSERT INTO url_occurrences (url_id, time, poster) "
+		  "SELECT c.id, l.time, '' FROM url_log l JOIN url_catalog c ON c.URL = l.URL ORDER BY l.id",
+		  "DROP TABLE url_log",
+	  } },
+	{ 3, "URL archive block index", { } },
+	{ 4, "LastSeen counters and rollups", { } }, // counters are seeded by LastSeen::Init
+	{ 5, "Canonical URL keys", { } }, // keys are filled in by UrlPreview::Init
+	{ 6, "URL fetch telemetry", { } },
+};
+
+// sync_schema may rebuild a table (dropping its indices) when columns change,
+// so indices are ensured after every migration run
+static const std::vector<std::string> indices = {
+	"CREATE INDEX IF NOT EXISTS quotes_index ON quotes(\"index\")",
+	"CREATE INDEX IF NOT EXISTS summoners_summonerID ON summoners(summonerID)",
+	"CREATE INDEX IF NOT EXISTS rss_URL ON rss(URL)",
+	"CREATE INDEX IF NOT EXISTS nicks_uniqueID ON nicks(uniqueID)",
+	"CREATE INDEX IF NOT EXISTS url_catalog_last_seen ON url_catalog(last_seen)",
+	"CREATE INDEX IF NOT EXISTS url_catalog_canonical ON url_catalog(canonical)",
+	"CREATE INDEX IF NOT EXISTS url_occurrences_url_id ON url_occurrences(url_id)",
+	"CREATE INDEX IF NOT EXISTS url_occurrences_time ON url_occurrences(time)",
+	"CREATE INDEX IF NOT EXISTS url_archive_blocks_month ON url_archive_blocks(month)",
+	"CREATE INDEX IF NOT EXISTS url_archive_blocks_first_time ON url_archive_blocks(first_time)",
+	"CREATE INDEX IF NOT EXISTS url_fetches_time ON url_fetches(time)",
+};
+
+const std::vector<Migration> &GetMigrations()
+{
+	return migrations;
+}
+
+int LatestSchemaVersion()
+{
+	return migrations.empty() ? 0 : migrations.back()._version;
+}
+
+bool MigrateDatabase(const std::string &path, Storage &storage)
+{
+	if (path == ":memory:")
+	{
+		storage.sync_schema();
+		return true;
+	}
+
+	SQLiteConnection db(path);
+	if (!db.IsOpen())
+		return false;
+
+	auto version = db.QueryInt("PRAGMA user_version");
+	if (!version)
+		return false;
+
+	if (*version == LatestSchemaVersion())
+		return true;
+
+	if (*version > LatestSchemaVersion())
+	{
+		LOG(ERROR) << path << " has schema version " << *version
+				   << ", this build only knows up to " << LatestSchemaVersion();
+		return false;
+	}
+
+	LOG(WARNING) << "Migrating " << path << " from schema version " << *version << " to " << LatestSchemaVersion();
+
+	try {
+		storage.sync_schema(true);
+	} catch (std::exception &e) {
+		LOG(ERROR) << "sync_schema failed for " << path << ": " << e.what();
+		return false;
+	}
+
+	for (const auto &migration : migrations)
+	{
+		if (migration._version <= *version)
+			continue;
+
+		LOG(INFO) << "Applying migration " << migration._version << ": " << migration._description;
+
+		bool success = db.Execute("BEGIN");
+		for (const auto &statement : migration._statements)
+			success = success && db.Execute(statement);
+		success = success && db.Execute("PRAGMA user_version = " + std::to_string(migration._version));
+
+		if (!success || !db.Execute("COMMIT"))
+		{
+			LOG(ERROR) << "Migration " << migration._version << " failed, rolling back";
+			db.Execute("ROLLBACK");
+			return false;
+		}
+	}
+
+	for (const auto &index : indices)
+		if (!db.Execute(index))
+			return false;
+
+	return true;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+TEST(Migrations, FreshDatabase)
+{
+	const std::string path = "testdb/migrations_test.db";
+	std::remove(path.c_str());
+
+	auto storage = initStorage(path);
+	ASSERT_TRUE(MigrateDatabase(path, storage));
+
+	{
+		SQLiteConnection db(path);
+		EXPECT_EQ(LatestSchemaVersion(), db.QueryInt("PRAGMA user_version").value_or(-1));
+		EXPECT_EQ(1, db.QueryInt("SELECT count(*) FROM sqlite_master WHERE type = 'index' AND name = 'quotes_index'").value_or(0));
+	}
+
+	// Up to date database is left alone
+	ASSERT_TRUE(MigrateDatabase(path, storage));
+	EXPECT_EQ(0, storage.count<DB::Quote>());
+}
+
+TEST(Migrations, NewerDatabase)
+{
+	const std::string path = "testdb/migrations_newer_test.db";
+	std::remove(path.c_str());
+
+	{
+		SQLiteConnection db(path);
+		ASSERT_TRUE(db.Execute("PRAGMA user_version = " + std::to_string(LatestSchemaVersion() + 1)));
+	}
+
+	auto storage = initStorage(path);
+	EXPECT_FALSE(MigrateDatabase(path, storage));
+}
+
+TEST(Migrations, URLCatalog)
+{
+	const std::string path = "testdb/migrations_url_test.db";
+	std::remove(path.c_str());
+
+	{
+		SQLiteConnection db(path);
+		ASSERT_TRUE(db.Execute("CREATE TABLE url_log (id INTEGER PRIMARY KEY AUTOINCREMENT, URL TEXT, title TEXT, time INTEGER, fulltext TEXT);"
+							   "INSERT INTO url_log (URL, title, time, fulltext) VALUES ('http://a/', 'A', 10, 'http://a/ A');"
+							   "INSERT INTO url_log (URL, title, time, fulltext) VALUES ('http://b/', 'B', 20, 'http://b/ B');"
+							   "INSERT INTO url_log (URL, title, time, fulltext) VALUES ('http://a/', '', 30, 'http://a/ ');"
+							   "PRAGMA user_version = 1;"));
+	}
+
+	auto storage = initStorage(path);
+	ASSERT_TRUE(MigrateDatabase(path, storage));
+
+	EXPECT_EQ(2, storage.count<DB::CatalogURL>());
+	EXPECT_EQ(3, storage.count<DB::URLOccurrence>());
+
+	using namespace sqlite_orm;
+	auto a = storage.get_all<DB::CatalogURL>(where(is_equal(&DB::CatalogURL::URL, "http://a/")));
+	ASSERT_EQ(1, a.size());
+	EXPECT_EQ("A", a.front().title);
+	EXPECT_EQ(10, a.front().firstSeen);
+	EXPECT_EQ(30, a.front().lastSeen);
+	EXPECT_EQ(2, a.front().postCount);
+
+	SQLiteConnection db(path);
+	EXPECT_EQ(0, db.QueryInt("SELECT count(*) FROM sqlite_master WHERE name = 'url_log'").value_or(-1));
+}
+
+#endif // LCOV_EXCL_STOP
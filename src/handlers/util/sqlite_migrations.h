@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "sqlite_db.h"
+
+class Migration
+{
+public:
+	int _version;
+	std::string _description;
+	std::vector<std::string> _statements;
+};
+
+const std::vector<Migration> &GetMigrations();
+int LatestSchemaVersion();
+
+/**
+ * @brief Bring database at path up to the latest schema version
+ *
+ * Schema version is kept in PRAGMA user_version. Table introspection (sync_schema)
+ * and migrations only run when stored version is behind, so opening an up to date
+ * database costs a single pragma read regardless of table sizes.
+ * @return False if migration failed or database was created by a newer build
+ */
+bool MigrateDatabase(const std::string &path, Storage &storage);
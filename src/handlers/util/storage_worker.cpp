@@ -0,0 +1,213 @@
+#include "storage_worker.h"
+
+#include <glog/logging.h>
+
+#include "thread_util.h"
+
+StorageWorker::StorageWorker(Storage &storage)
+	: _storage(storage)
+	, _isAsync(false)
+{
+
+}
+
+StorageWorker::StorageWorker(Storage &storage, const std::string &name)
+	: _storage(storage)
+	, _isAsync(true)
+{
+	_thread = std::thread(&StorageWorker::Run, this);
+	nameThread(_thread, name);
+}
+
+StorageWorker::~StorageWorker()
+{
+	if (!_isAsync)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_isRunning = false;
+	}
+
+	// Queued jobs are still executed before the thread exits
+	_wakeup.notify_all();
+	_thread.join();
+}
+
+void StorageWorker::Flush()
+{
+	if (!_isAsync)
+		return;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this] { return _queue.empty() && !_isBusy; });
+}
+
+void StorageWorker::Enqueue(Job &&job)
+{
+	if (!_isAsync)
+	{
+		if (job._isMutation)
+		{
+			std::vector<Job> batch;
+			batch.push_back(std::move(job));
+			ExecuteMutations(batch);
+		} else
+			ExecuteQuery(job);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(std::move(job));
+	}
+	_wakeup.notify_one();
+}
+
+void StorageWorker::Run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_wakeup.wait(lock, [this] { return !_queue.empty() || !_isRunning; });
+		if (_queue.empty())
+			break;
+
+		// Either one query or a run of adjacent mutations
+		std::vector<Job> batch;
+		do {
+			batch.push_back(std::move(_queue.front()));
+			_queue.pop_front();
+		} while (batch.front()._isMutation && !_queue.empty() && _queue.front()._isMutation
+				 && batch.size() < maxBatchSize);
+
+		_isBusy = true;
+		lock.unlock();
+
+		if (batch.front()._isMutation)
+			ExecuteMutations(batch);
+		else
+			ExecuteQuery(batch.front());
+
+		lock.lock();
+		_isBusy = false;
+		if (_queue.empty())
+			_idle.notify_all();
+	}
+}
+
+void StorageWorker::ExecuteQuery(Job &job)
+{
+	// packaged_task keeps exceptions for the caller
+	job._run(_storage);
+}
+
+void StorageWorker::ExecuteMutations(std::vector<Job> &batch)
+{
+	if (batch.size() > 1 && CommitBatch(batch))
+		return;
+
+	for (auto &job : batch)
+	{
+		std::exception_ptr error;
+		try {
+			_storage.transaction([&] {
+				try {
+					job._run(_storage);
+				} catch (std::exception &e) {
+					LOG(ERROR) << "Storage job failed: " << e.what();
+					error = std::current_exception();
+					return false;
+				}
+				return true;
+			});
+		} catch (std::exception &e) {
+			LOG(ERROR) << "Storage job failed: " << e.what();
+			error = error ? error : std::current_exception();
+		}
+
+		job._complete(error);
+	}
+}
+
+bool StorageWorker::CommitBatch(std::vector<Job> &batch)
+{
+	bool committed = false;
+	try {
+		committed = _storage.transaction([&] {
+			try {
+				for (auto &job : batch)
+					job._run(_storage);
+			} catch (std::exception &e) {
+				LOG(WARNING) << "Storage batch of " << batch.size() << " jobs rolled back: " << e.what();
+				return false;
+			}
+			return true;
+		});
+	} catch (std::exception &e) {
+		LOG(WARNING) << "Storage batch of " << batch.size() << " jobs failed: " << e.what();
+		return false;
+	}
+
+	if (!committed)
+		return false;
+
+	for (auto &job : batch)
+		job._complete(nullptr);
+	return true;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(StorageWorker, BatchedMutations)
+{
+	auto storage = initStorage(":memory:");
+	storage.sync_schema();
+
+	std::vector<std::future<void>> results;
+	{
+		StorageWorker worker(storage, "storage test");
+
+		for (int i = 1; i <= 100; i++)
+		{
+			results.push_back(worker.Mutate([i](Storage &db) {
+				if (i == 50)
+					throw std::runtime_error("broken job");
+
+				DB::Quote quote = { -1, i, "quote " + std::to_string(i), "", "" };
+				db.insert(quote);
+			}));
+		}
+
+		// Queries see everything queued before them
+		EXPECT_EQ(99, worker.Query([](Storage &db) { return db.count<DB::Quote>(); }).get());
+
+		worker.Mutate([](Storage &db) { db.remove_all<DB::Quote>(); });
+		worker.Flush();
+		EXPECT_EQ(0, storage.count<DB::Quote>());
+	}
+
+	EXPECT_THROW(results[49].get(), std::runtime_error);
+	results.erase(results.begin() + 49);
+	for (auto &result : results)
+		EXPECT_NO_THROW(result.get());
+}
+
+TEST(StorageWorker, Synchronous)
+{
+	auto storage = initStorage(":memory:");
+	storage.sync_schema();
+
+	StorageWorker worker(storage);
+	auto result = worker.Mutate([](Storage &db) {
+		DB::Quote quote = { -1, 1, "quote", "", "" };
+		db.insert(quote);
+	});
+
+	EXPECT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(0)));
+	EXPECT_EQ(1, storage.count<DB::Quote>());
+}
+
+#endif // LCOV_EXCL_STOP
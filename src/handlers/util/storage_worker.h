@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+#include "sqlite_db.h"
+
+/**
+ * Runs storage jobs on a dedicated thread so chat processing doesn't wait for disk.
+ *
+ * Mutate() jobs that are queued next to each other are committed together in one
+ * transaction (if any of them throws, the batch is rolled back and every job is
+ * retried in its own transaction, so each job stays atomic).
+ * Query() jobs run alone, outside of batches, and may start their own transactions.
+ * Jobs are executed in submission order, so a query sees all earlier mutations.
+ *
+ * Synchronous worker (no thread) runs jobs right away on the calling thread.
+ */
+class StorageWorker
+{
+public:
+	// Synchronous worker
+	explicit StorageWorker(Storage &storage);
+	// Worker with its own thread
+	StorageWorker(Storage &storage, const std::string &name);
+	~StorageWorker();
+
+	StorageWorker(const StorageWorker &) = delete;
+	StorageWorker &operator=(const StorageWorker &) = delete;
+
+	template <class Job>
+	auto Query(Job job) -> std::future<std::invoke_result_t<Job, Storage&>>
+	{
+		using Result = std::invoke_result_t<Job, Storage&>;
+		auto task = std::make_shared<std::packaged_task<Result(Storage&)>>(std::move(job));
+		auto future = task->get_future();
+		Enqueue({ false, [task](Storage &storage) { (*task)(storage); }, {} });
+		return future;
+	}
+
+	template <class Job>
+	std::future<void> Mutate(Job job)
+	{
+		auto promise = std::make_shared<std::promise<void>>();
+		auto future = promise->get_future();
+		Enqueue({ true, std::move(job), [promise](std::exception_ptr error) {
+			if (error)
+				promise->set_exception(error);
+			else
+				promise->set_value();
+		}});
+		return future;
+	}
+
+	// Blocks until all jobs queued so far are done
+	void Flush();
+
+private:
+	struct Job
+	{
+		bool _isMutation;
+		std::function<void(Storage&)> _run;
+		std::function<void(std::exception_ptr)> _complete; // mutations only, called after commit
+	};
+
+	void Enqueue(Job &&job);
+	void Run();
+	void ExecuteQuery(Job &job);
+	void ExecuteMutations(std::vector<Job> &batch);
+	bool CommitBatch(std::vector<Job> &batch);
+
+	Storage &_storage;
+	bool _isAsync;
+
+	std::mutex _mutex;
+	std::condition_variable _wakeup;
+	std::condition_variable _idle;
+	std::deque<Job> _queue;
+	bool _isBusy = false;
+	bool _isRunning = true;
+	std::thread _thread;
+
+	static constexpr size_t maxBatchSize = 256;
+};
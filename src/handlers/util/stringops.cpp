@@ -1,8 +1,14 @@
 #include "stringops.h"
 
-#include <regex>
+#include <array>
+#include <algorithm>
+#include <string_view>
 #include <boost/locale.hpp>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "glog/logging.h"
 
 void initLocale()
@@ -81,17 +87,132 @@ std::vector<std::string> tokenize(const std::string &input, char separator, int
 	return tokens;
 }
 
+namespace {
+
+enum URLCharClass : unsigned char
+{
+	HostChar = 1, // [[:alnum:].]
+	PathChar = 2, // [[:alnum:]\-._~:/?#\[\]@!$&'()*+,;=%]
+};
+
+constexpr std::array<unsigned char, 256> makeURLCharTable()
+{
+	std::array<unsigned char, 256> table = {};
+	for (int c = '0'; c <= '9'; c++)
+		table[c] = HostChar | PathChar;
+	for (int c = 'a'; c <= 'z'; c++)
+		table[c] = HostChar | PathChar;
+	for (int c = 'A'; c <= 'Z'; c++)
+		table[c] = HostChar | PathChar;
+	table['.'] = HostChar | PathChar;
+
+	for (char c : std::string_view("-_~:/?#[]@!$&'()*+,;=%"))
+		table[static_cast<unsigned char>(c)] |= PathChar;
+
+	return table;
+}
+
+constexpr auto urlCharTable = makeURLCharTable();
+
+bool hasClass(char c, URLCharClass charClass)
+{
+	return urlCharTable[static_cast<unsigned char>(c)] & charClass;
+}
+
+// Position of the next "ht" pair, the only way a URL can start
+size_t findURLCandidate(const std::string &input, size_t from)
+{
+	const char *data = input.data();
+	const size_t size = input.size();
+
+#ifdef __SSE2__
+	const __m128i h = _mm_set1_epi8('h');
+	const __m128i t = _mm_set1_epi8('t');
+	for (; from + 17 <= size; from += 16)
+	{
+		auto first = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from));
+		auto second = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + from + 1));
+		int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, h), _mm_cmpeq_epi8(second, t)));
+		if (mask != 0)
+			return from + __builtin_ctz(mask);
+	}
+#endif
+
+	for (; from + 1 < size; from++)
+		if (data[from] == 'h' && data[from + 1] == 't')
+			return from;
+
+	return std::string::npos;
+}
+
+size_t skipClass(const std::string &input, size_t from, URLCharClass charClass)
+{
+	while (from < input.size() && hasClass(input[from], charClass))
+		from++;
+	return from;
+}
+
+class URLMatch
+{
+public:
+	size_t _end;
+	size_t _hostBegin;
+	size_t _hostEnd;
+};
+
+// Same as matching https?://(?:www.)?([[:alnum:].]+)/?[[:alnum:]\-._~:/?#\[\]@!$&'()*+,;=%]* at start
+std::optional<URLMatch> matchURL(const std::string &input, size_t start)
+{
+	size_t pos = start;
+	if (input.compare(pos, 4, "http") != 0)
+		return {};
+	pos += 4;
+
+	if (pos < input.size() && input[pos] == 's')
+		pos++;
+
+	if (input.compare(pos, 3, "://") != 0)
+		return {};
+	pos += 3;
+
+	// (?:www.)? is greedy, but gives up its match if no hostname is left after it
+	size_t hostBegin = pos;
+	if (input.compare(pos, 3, "www") == 0
+			&& pos + 3 < input.size()
+			&& input[pos + 3] != '\n' && input[pos + 3] != '\r'
+			&& skipClass(input, pos + 4, HostChar) > pos + 4)
+		hostBegin = pos + 4;
+
+	size_t hostEnd = skipClass(input, hostBegin, HostChar);
+	if (hostEnd == hostBegin)
+		return {};
+
+	size_t end = hostEnd;
+	if (end < input.size() && input[end] == '/')
+		end++;
+
+	return URLMatch{ skipClass(input, end, PathChar), hostBegin, hostEnd };
+}
+
+}
+
 std::list<URL> findURLs(const std::string &input)
 {
 	std::list<URL> output;
 
-	static const std::regex trivialUrl("(https?://(?:www.)?([[:alnum:].]+)/?[[:alnum:]\\-._~:/?#\\[\\]@!$&'()*+,;=%]*)");
-
-	for (std::sregex_iterator i(input.begin(), input.end(), trivialUrl);
-		 i != std::sregex_iterator(); ++i)
+	size_t pos = 0;
+	while ((pos = findURLCandidate(input, pos)) != std::string::npos)
 	{
-		const auto &url = i->str(1);
-		output.push_back(URL(url.substr(0, url.find('#')), i->str(2)));
+		auto match = matchURL(input, pos);
+		if (!match)
+		{
+			pos++;
+			continue;
+		}
+
+		auto url = input.substr(pos, match->_end - pos);
+		output.push_back(URL(url.substr(0, url.find('#')), input.substr(match->_hostBegin, match->_hostEnd - match->_hostBegin)));
+		pos = match->_end;
 	}
 
 	output.erase(std::unique(output.begin(), output.end()), output.end());
@@ -148,6 +269,10 @@ std::optional<size_t> from_string<size_t>(const std::string &input)
 
 #include <gtest/gtest.h>
 
+#include <regex>
+#include <random>
+#include <iostream>
+
 TEST(StringOps, toLower_ruRU)
 {
 	boost::locale::generator gen;
@@ -181,6 +306,98 @@ TEST(StringOps, findURLs)
 	EXPECT_EQ("youtube.com", urls.begin()->_hostname);
 }
 
+namespace {
+
+std::list<URL> findURLsWithRegex(const std::string &input)
+{
+	std::list<URL> output;
+
+	static const std::regex trivialUrl("(https?://(?:www.)?([[:alnum:].]+)/?[[:alnum:]\\-._~:/?#\\[\\]@!$&'()*+,;=%]*)");
+
+	for (std::sregex_iterator i(input.begin(), input.end(), trivialUrl);
+		 i != std::sregex_iterator(); ++i)
+	{
+		const auto &url = i->str(1);
+		output.push_back(URL(url.substr(0, url.find('#')), i->str(2)));
+	}
+
+	output.erase(std::unique(output.begin(), output.end()), output.end());
+
+	return output;
+}
+
+std::vector<std::string> makeChatCorpus(size_t lines)
+{
+	static const std::vector<std::string> pieces = {
+		"http", "https", "://", "www", "www.", "ht", "h", "t", "p", "s", ":", "/", "//", ".", "#", "?", "=", "&",
+		"example", "ya.ru", "Test", "42", " ", "  ", "\n", "\r", "\t", "-", "_", "~", "[", "]", "(", ")", "'", "\"",
+		"<", ">", "^", "`", "{", "|", "%20", u8"привет", u8"ссылка", "\xff", "\x80", "hTTp", "HTTP://",
+	};
+
+	std::mt19937 random(42);
+	std::uniform_int_distribution<size_t> pieceIndex(0, pieces.size() - 1);
+	std::uniform_int_distribution<int> lineLength(1, 40);
+
+	std::vector<std::string> corpus;
+	for (size_t i = 0; i < lines; i++)
+	{
+		std::string line;
+		for (int j = lineLength(random); j > 0; j--)
+			line += pieces[pieceIndex(random)];
+		corpus.push_back(line);
+	}
+	return corpus;
+}
+
+}
+
+TEST(StringOps, findURLsSameAsRegex)
+{
+	for (const auto &line : makeChatCorpus(20000))
+	{
+		auto expected = findURLsWithRegex(line);
+		auto actual = findURLs(line);
+		ASSERT_EQ(expected.size(), actual.size()) << line;
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), actual.begin())) << line;
+	}
+
+	EXPECT_EQ("example.com", findURLs("http://www.example.com").front()._hostname);
+	EXPECT_EQ("www.", findURLs("http://www./path").front()._hostname);
+	EXPECT_EQ("com", findURLs("http://wwwxcom").front()._hostname);
+	EXPECT_EQ("www", findURLs("http://www\ncom").front()._hostname);
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(StringOps, DISABLED_findURLsBenchmark)
+{
+	auto corpus = makeChatCorpus(2000);
+	for (int i = 0; i < 8000; i++)
+		corpus.push_back(u8"Just a regular chat message without any links, ну или почти без них " + std::to_string(i));
+	for (int i = 0; i < 2000; i++)
+		corpus.push_back("look at https://www.youtube.com/watch?v=" + std::to_string(i) + " and http://example.com/page#" + std::to_string(i));
+
+	size_t bytes = 0;
+	for (const auto &line : corpus)
+		bytes += line.size();
+
+	auto measure = [&](auto &&finder) {
+		size_t found = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const auto &line : corpus)
+			found += finder(line).size();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return std::make_pair(found, bytes / elapsed.count() / (1024 * 1024));
+	};
+
+	auto regex = measure(findURLsWithRegex);
+	auto scanner = measure(findURLs);
+	EXPECT_EQ(regex.first, scanner.first);
+
+	std::cout << corpus.size() << " lines, " << bytes << " bytes, " << scanner.first << " URLs" << std::endl
+			  << "  std::regex: " << regex.second << " MiB/s" << std::endl
+			  << "  scanner:    " << scanner.second << " MiB/s" << std::endl;
+}
+
 TEST(StringOps, beginsWith)
 {
 	EXPECT_TRUE(beginsWith("!test", "!test"));
@@ -0,0 +1,111 @@
+#include "title_cache.h"
+
+#include <algorithm>
+
+TitleCache::TitleCache(size_t capacity, std::chrono::seconds ttl, std::chrono::seconds failureTtl)
+	: _capacity(std::max<size_t>(capacity, 1))
+	, _ttl(ttl)
+	, _failureTtl(failureTtl)
+{
+
+}
+
+void TitleCache::Put(const std::string &url, const std::string &title, Clock::time_point fetched)
+{
+	Insert(url, { title, false }, fetched + _ttl);
+}
+
+void TitleCache::PutFailure(const std::string &url, Clock::time_point fetched)
+{
+	Insert(url, { "", true }, fetched + _failureTtl);
+}
+
+std::optional<TitleCache::Entry> TitleCache::Get(const std::string &url, Clock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto item = _index.find(url);
+	if (item == _index.end())
+		return {};
+
+	if (item->second->_expires <= now)
+	{
+		_items.erase(item->second);
+		_index.erase(item);
+		return {};
+	}
+
+	_items.splice(_items.begin(), _items, item->second);
+	return item->second->_entry;
+}
+
+size_t TitleCache::Size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _items.size();
+}
+
+std::chrono::seconds TitleCache::GetTTL() const
+{
+	return _ttl;
+}
+
+void TitleCache::Insert(const std::string &url, Entry &&entry, Clock::time_point expires)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto existing = _index.find(url);
+	if (existing != _index.end())
+	{
+		existing->second->_entry = std::move(entry);
+		existing->second->_expires = expires;
+		_items.splice(_items.begin(), _items, existing->second);
+		return;
+	}
+
+	_items.push_front({ url, std::move(entry), expires });
+	_index[url] = _items.begin();
+
+	if (_items.size() > _capacity)
+	{
+		_index.erase(_items.back()._url);
+		_items.pop_back();
+	}
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(TitleCache, ExpiryAndEviction)
+{
+	using std::chrono::seconds;
+	TitleCache cache(2, seconds(100), seconds(10));
+	auto now = TitleCache::Clock::now();
+
+	cache.Put("http://a", "A", now);
+	cache.PutFailure("http://b", now);
+
+	ASSERT_TRUE(cache.Get("http://a", now + seconds(50)).has_value());
+	EXPECT_EQ("A", cache.Get("http://a", now + seconds(50))->_title);
+	EXPECT_TRUE(cache.Get("http://b", now + seconds(5))->_isFailure);
+
+	// Failures expire sooner
+	EXPECT_FALSE(cache.Get("http://b", now + seconds(10)).has_value());
+	EXPECT_EQ(1, cache.Size());
+
+	// "a" is the most recently used, "c" gets evicted by "d"
+	cache.Put("http://c", "C", now);
+	cache.Get("http://a", now);
+	cache.Put("http://d", "D", now);
+	EXPECT_TRUE(cache.Get("http://a", now).has_value());
+	EXPECT_FALSE(cache.Get("http://c", now).has_value());
+	EXPECT_TRUE(cache.Get("http://d", now).has_value());
+
+	// Entries warmed with their original fetch time keep the remaining TTL only
+	cache.Put("http://old", "Old", now - seconds(99));
+	EXPECT_TRUE(cache.Get("http://old", now).has_value());
+	EXPECT_FALSE(cache.Get("http://old", now + seconds(1)).has_value());
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * LRU cache of page titles by URL.
+ *
+ * Titles live for ttl since the page was fetched; failed fetches (errors,
+ * timeouts, non-200 responses) are remembered for the shorter failureTtl.
+ */
+class TitleCache
+{
+public:
+	using Clock = std::chrono::system_clock;
+
+	class Entry
+	{
+	public:
+		std::string _title;
+		bool _isFailure = false;
+	};
+
+	TitleCache(size_t capacity, std::chrono::seconds ttl, std::chrono::seconds failureTtl);
+
+	void Put(const std::string &url, const std::string &title, Clock::time_point fetched = Clock::now());
+	void PutFailure(const std::string &url, Clock::time_point fetched = Clock::now());
+	std::optional<Entry> Get(const std::string &url, Clock::time_point now = Clock::now());
+
+	size_t Size() const;
+	std::chrono::seconds GetTTL() const;
+
+private:
+	void Insert(const std::string &url, Entry &&entry, Clock::time_point expires);
+
+	class Item
+	{
+	public:
+		std::string _url;
+		Entry _entry;
+		Clock::time_point _expires;
+	};
+
+	size_t _capacity;
+	std::chrono::seconds _ttl;
+	std::chrono::seconds _failureTtl;
+
+	mutable std::mutex _mutex;
+	std::list<Item> _items; // most recently used first
+	std::unordered_map<std::string, std::list<Item>::iterator> _index;
+};
@@ -0,0 +1,188 @@
+#include "trigram_index.h"
+
+#include <algorithm>
+
+#include "stringops.h"
+
+void TrigramIndex::Insert(const std::string &key, const std::string &payload)
+{
+	auto existing = _ids.find(key);
+	if (existing != _ids.end())
+	{
+		_entries[existing->second]._payload = payload;
+		return;
+	}
+
+	auto id = static_cast<std::uint32_t>(_entries.size());
+	auto folded = fold(key);
+	auto grams = trigrams(folded);
+
+	// Ids grow monotonically, so posting lists stay sorted
+	for (auto gram : grams)
+		_postings[gram].push_back(id);
+
+	_entries.push_back({key, folded, payload, static_cast<std::uint32_t>(grams.size())});
+	_ids.emplace(key, id);
+}
+
+bool TrigramIndex::Contains(const std::string &key) const
+{
+	return _ids.find(key) != _ids.end();
+}
+
+size_t TrigramIndex::Size() const
+{
+	return _entries.size();
+}
+
+std::vector<TrigramIndex::Match> TrigramIndex::Search(const std::string &query, size_t limit) const
+{
+	std::vector<Match> result;
+	auto folded = fold(query);
+	if (folded.empty() || limit == 0)
+		return result;
+
+	auto grams = trigrams(folded);
+
+	std::unordered_map<std::uint32_t, std::uint32_t> shared;
+	for (auto gram : grams)
+	{
+		auto posting = _postings.find(gram);
+		if (posting == _postings.end())
+			continue;
+
+		for (auto id : posting->second)
+			++shared[id];
+	}
+
+	// Queries under 3 bytes only have edge trigrams, occurrences inside keys are found by a scan
+	if (folded.size() < 3)
+	{
+		for (std::uint32_t id = 0; id < _entries.size(); id++)
+		{
+			if (_entries[id]._folded.find(folded) != std::string::npos)
+				shared.emplace(id, 0);
+		}
+	}
+
+	for (const auto &candidate : shared)
+	{
+		const auto &entry = _entries[candidate.first];
+		auto common = candidate.second;
+		double similarity = static_cast<double>(common) / (grams.size() + entry._trigramCount - common);
+		bool isSubstring = entry._folded.find(folded) != entry._folded.npos;
+
+		if (!isSubstring && similarity < minSimilarity)
+			continue;
+
+		result.push_back({entry._key, entry._payload, similarity, isSubstring});
+	}
+
+	auto byRelevance = [](const Match &lhs, const Match &rhs) {
+		if (lhs._isSubstring != rhs._isSubstring)
+			return lhs._isSubstring;
+		if (lhs._score != rhs._score)
+			return lhs._score > rhs._score;
+		return lhs._key < rhs._key;
+	};
+
+	if (result.size() > limit)
+	{
+		std::partial_sort(result.begin(), result.begin() + limit, result.end(), byRelevance);
+		result.resize(limit);
+	} else {
+		std::sort(result.begin(), result.end(), byRelevance);
+	}
+
+	return result;
+}
+
+std::string TrigramIndex::fold(const std::string &input)
+{
+	bool isASCII = std::all_of(input.begin(), input.end(), [](char c) {
+		return static_cast<unsigned char>(c) < 0x80;
+	});
+
+	if (!isASCII)
+		return toLower(input);
+
+	std::string folded(input);
+	for (auto &c : folded)
+		if (c >= 'A' && c <= 'Z')
+			c = c - 'A' + 'a';
+
+	return folded;
+}
+
+std::vector<std::uint32_t> TrigramIndex::trigrams(const std::string &folded)
+{
+	// Padding lets short strings and word boundaries produce trigrams too
+	auto padded = "  " + folded + " ";
+
+	std::vector<std::uint32_t> grams;
+	grams.reserve(padded.size());
+	for (size_t pos = 0; pos + 2 < padded.size(); pos++)
+	{
+		grams.push_back(static_cast<std::uint32_t>(static_cast<unsigned char>(padded[pos])) << 16
+				| static_cast<std::uint32_t>(static_cast<unsigned char>(padded[pos + 1])) << 8
+				| static_cast<std::uint32_t>(static_cast<unsigned char>(padded[pos + 2])));
+	}
+
+	std::sort(grams.begin(), grams.end());
+	grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+	return grams;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(TrigramIndex, SubstringAndSimilarity)
+{
+	TrigramIndex index;
+	index.Insert("Alice", "alice@example.com");
+	index.Insert("Bob", "bob@example.com");
+	index.Insert("Malice", "malice@example.com");
+	index.Insert("Alicia", "alicia@example.com");
+
+	auto matches = index.Search("lice", 10);
+	ASSERT_EQ(2, matches.size());
+	EXPECT_TRUE(matches.at(0)._isSubstring);
+	EXPECT_TRUE(matches.at(1)._isSubstring);
+
+	matches = index.Search("ALICE", 10);
+	ASSERT_FALSE(matches.empty());
+	EXPECT_EQ("Alice", matches.front()._key);
+	EXPECT_EQ("alice@example.com", matches.front()._payload);
+
+	matches = index.Search("Alicw", 10);
+	ASSERT_FALSE(matches.empty());
+	EXPECT_FALSE(matches.front()._isSubstring);
+
+	EXPECT_TRUE(index.Search("zzz", 10).empty());
+	EXPECT_EQ(1, index.Search("lice", 1).size());
+
+	// Short fragments match inside keys too
+	matches = index.Search("li", 10);
+	ASSERT_EQ(3, matches.size());
+	for (const auto &match : matches)
+		EXPECT_TRUE(match._isSubstring);
+	EXPECT_EQ(1, index.Search("o", 10).size());
+}
+
+TEST(TrigramIndex, PayloadUpdate)
+{
+	TrigramIndex index;
+	index.Insert("Bob", "bob@example.com");
+	index.Insert("Bob", "bob@example.org");
+
+	EXPECT_EQ(1, index.Size());
+	EXPECT_TRUE(index.Contains("Bob"));
+	EXPECT_FALSE(index.Contains("bob"));
+
+	auto matches = index.Search("bob", 10);
+	ASSERT_EQ(1, matches.size());
+	EXPECT_EQ("bob@example.org", matches.front()._payload);
+}
+
+#endif // LCOV_EXCL_STOP
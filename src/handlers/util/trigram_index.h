@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+ * In-memory trigram index for fuzzy lookups over short strings (nicks, JIDs).
+ * Every key carries a payload (e.g. JID for a nick), re-inserting a key updates it.
+ */
+class TrigramIndex
+{
+public:
+	class Match
+	{
+	public:
+		std::string _key;
+		std::string _payload;
+		double _score = 0;
+		bool _isSubstring = false;
+	};
+
+	void Insert(const std::string &key, const std::string &payload);
+	bool Contains(const std::string &key) const;
+	size_t Size() const;
+
+	/**
+	 * @brief Find keys similar to query or containing it
+	 * @return Matches ordered by relevance, substring matches first
+	 */
+	std::vector<Match> Search(const std::string &query, size_t limit) const;
+
+private:
+	static std::string fold(const std::string &input);
+	static std::vector<std::uint32_t> trigrams(const std::string &folded);
+
+	class Entry
+	{
+	public:
+		std::string _key;
+		std::string _folded;
+		std::string _payload;
+		std::uint32_t _trigramCount = 0;
+	};
+
+	std::vector<Entry> _entries;
+	std::unordered_map<std::string, std::uint32_t> _ids;
+	std::unordered_map<std::uint32_t, std::vector<std::uint32_t>> _postings;
+
+	static constexpr double minSimilarity = 0.3;
+};
@@ -0,0 +1,168 @@
+#include "url_archive.h"
+
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+#include <zlib.h>
+#include <glog/logging.h>
+#include <json/reader.h>
+#include <json/writer.h>
+#include <json/value.h>
+
+URLArchive::URLArchive(const std::string &pathPrefix)
+	: _pathPrefix(pathPrefix)
+{
+
+}
+
+std::optional<std::vector<DB::URLArchiveBlock>> URLArchive::Append(const std::vector<ArchivedURL> &records) const
+{
+	std::vector<DB::URLArchiveBlock> blocks;
+	Json::FastWriter writer;
+
+	size_t begin = 0;
+	while (begin < records.size())
+	{
+		auto month = MonthOf(records[begin]._timestamp);
+
+		std::string raw;
+		size_t end = begin;
+		while (end < records.size()
+			   && end - begin < blockRows
+			   && MonthOf(records[end]._timestamp) == month)
+		{
+			Json::Value line;
+			line["url"] = records[end]._url;
+			line["title"] = records[end]._title;
+			line["time"] = static_cast<Json::Int64>(records[end]._timestamp);
+			line["poster"] = records[end]._poster;
+			raw += writer.write(line);
+			++end;
+		}
+
+		std::string compressed(compressBound(raw.size()), '\0');
+		auto compressedSize = static_cast<uLongf>(compressed.size());
+		if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &compressedSize,
+					  reinterpret_cast<const Bytef*>(raw.data()), raw.size(), Z_BEST_COMPRESSION) != Z_OK)
+		{
+			LOG(ERROR) << "Failed to compress URL archive block";
+			return {};
+		}
+
+		auto path = GetSegmentPath(month);
+		std::ofstream segment(path, std::ios::binary | std::ios::app);
+		segment.seekp(0, std::ios::end);
+		long offset = segment.tellp();
+		segment.write(compressed.data(), compressedSize);
+		segment.flush();
+		if (!segment)
+		{
+			LOG(ERROR) << "Failed to write URL archive segment " << path;
+			return {};
+		}
+
+		blocks.push_back({ -1, month, offset, static_cast<long>(compressedSize), static_cast<long>(raw.size()),
+						   records[begin]._timestamp, records[end - 1]._timestamp, static_cast<int>(end - begin) });
+		begin = end;
+	}
+
+	return blocks;
+}
+
+std::optional<std::vector<ArchivedURL>> URLArchive::ReadBlock(const DB::URLArchiveBlock &block) const
+{
+	std::ifstream segment(GetSegmentPath(block.month), std::ios::binary);
+	segment.seekg(block.offset);
+
+	std::string compressed(block.length, '\0');
+	segment.read(&compressed[0], block.length);
+	if (!segment)
+	{
+		LOG(ERROR) << "Failed to read URL archive block " << block.id;
+		return {};
+	}
+
+	std::string raw(block.rawLength, '\0');
+	auto rawSize = static_cast<uLongf>(raw.size());
+	if (uncompress(reinterpret_cast<Bytef*>(&raw[0]), &rawSize,
+				   reinterpret_cast<const Bytef*>(compressed.data()), compressed.size()) != Z_OK)
+	{
+		LOG(ERROR) << "URL archive block " << block.id << " is corrupted";
+		return {};
+	}
+	raw.resize(rawSize);
+
+	std::vector<ArchivedURL> records;
+	records.reserve(block.rows);
+
+	Json::Reader reader;
+	std::istringstream lines(raw);
+	std::string line;
+	while (std::getline(lines, line))
+	{
+		Json::Value value;
+		if (!reader.parse(line, value) || !value.isObject())
+			continue;
+
+		records.push_back({ value["url"].asString(), value["title"].asString(),
+							static_cast<long>(value["time"].asInt64()), value["poster"].asString() });
+	}
+
+	return records;
+}
+
+std::string URLArchive::GetSegmentPath(const std::string &month) const
+{
+	return _pathPrefix + month + ".seg";
+}
+
+std::string URLArchive::MonthOf(long timestamp)
+{
+	std::time_t time = timestamp;
+	std::tm utc = {};
+	gmtime_r(&time, &utc);
+
+	char month[8];
+	std::strftime(month, sizeof(month), "%Y-%m", &utc);
+	return month;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+TEST(URLArchive, RoundTrip)
+{
+	URLArchive archive("testdb/url_archive_test_");
+	std::remove(archive.GetSegmentPath("1970-01").c_str());
+	std::remove(archive.GetSegmentPath("1970-02").c_str());
+
+	std::vector<ArchivedURL> records;
+	for (long i = 0; i < 800; i++)
+		records.push_back({ "http://example.com/" + std::to_string(i), "Title\t\n" + std::to_string(i), i * 3600, "Bob" });
+
+	auto blocks = archive.Append(records);
+	ASSERT_TRUE(blocks.has_value());
+
+	// 744 hourly records in January split by block size, the rest goes to February
+	ASSERT_EQ(4, blocks->size());
+	EXPECT_EQ("1970-01", blocks->at(0).month);
+	EXPECT_EQ(256, blocks->at(0).rows);
+	EXPECT_EQ(232, blocks->at(2).rows);
+	EXPECT_EQ("1970-02", blocks->at(3).month);
+	EXPECT_EQ(56, blocks->at(3).rows);
+	EXPECT_EQ(0, blocks->at(0).firstTime);
+	EXPECT_EQ(255 * 3600, blocks->at(0).lastTime);
+
+	auto second = archive.ReadBlock(blocks->at(1));
+	ASSERT_TRUE(second.has_value());
+	ASSERT_EQ(blocks->at(1).rows, second->size());
+	EXPECT_EQ("http://example.com/256", second->front()._url);
+	EXPECT_EQ("Title\t\n256", second->front()._title);
+	EXPECT_EQ("Bob", second->front()._poster);
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "sqlite_db.h"
+
+class ArchivedURL
+{
+public:
+	std::string _url;
+	std::string _title;
+	long _timestamp = 0;
+	std::string _poster;
+};
+
+/**
+ * Append-only monthly segment files (%prefix%YYYY-MM.seg) made of independently
+ * zlib-compressed blocks. Block positions and time ranges are kept by the caller
+ * (url_archive_blocks table) and serve as a sparse time index into segments.
+ */
+class URLArchive
+{
+public:
+	explicit URLArchive(const std::string &pathPrefix);
+
+	/**
+	 * @brief Append records sorted by time, blocks never span months
+	 * @return Index entries for written blocks, nothing if write failed
+	 */
+	std::optional<std::vector<DB::URLArchiveBlock>> Append(const std::vector<ArchivedURL> &records) const;
+	std::optional<std::vector<ArchivedURL>> ReadBlock(const DB::URLArchiveBlock &block) const;
+
+	std::string GetSegmentPath(const std::string &month) const;
+	static std::string MonthOf(long timestamp);
+
+private:
+	std::string _pathPrefix;
+
+	static constexpr size_t blockRows = 256;
+};
@@ -0,0 +1,267 @@
+#include "url_canonicalizer.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+#include <glog/logging.h>
+#include <boost/algorithm/string.hpp>
+
+std::optional<URLHostRule> URLHostRule::Parse(const std::string &text)
+{
+	std::vector<std::string> directives;
+	boost::split(directives, text, boost::is_any_of(";"));
+
+	URLHostRule rule;
+	bool isEmpty = true;
+	for (auto &directive : directives)
+	{
+		boost::trim(directive);
+		if (directive.empty())
+			continue;
+
+		auto separator = directive.find('=');
+		if (separator == std::string::npos)
+		{
+			LOG(WARNING) << "Invalid URL canonicalization rule: " << text;
+			return {};
+		}
+
+		auto key = boost::trim_copy(directive.substr(0, separator));
+		auto value = boost::trim_copy(directive.substr(separator + 1));
+
+		std::vector<std::string> params;
+		boost::split(params, value, boost::is_any_of(","), boost::token_compress_on);
+		for (auto &param : params)
+			boost::trim(param);
+		params.erase(std::remove(params.begin(), params.end(), ""), params.end());
+
+		if (key == "host") {
+			rule._host = boost::to_lower_copy(value);
+		} else if (key == "keep") {
+			rule._keepParams = params;
+		} else if (key == "drop") {
+			rule._dropParams = params;
+		} else {
+			LOG(WARNING) << "Unknown URL canonicalization directive \"" << key << "\" in " << text;
+			return {};
+		}
+
+		isEmpty = false;
+	}
+
+	if (isEmpty)
+		return {};
+
+	return rule;
+}
+
+URLCanonicalizer::URLCanonicalizer()
+{
+	const std::vector<std::string> youtubeParams = { "si", "feature", "pp", "ab_channel" };
+	URLHostRule youtube = { "", {}, youtubeParams,
+							std::regex("^/(?:shorts|live)/([\\w-]+)/?(?:\\?(.*))?$"), "/watch?v=$1&$2" };
+	Add("youtube.com", youtube);
+	Add("youtu.be", { "youtube.com", {}, youtubeParams, std::regex("^/([\\w-]+)/?(?:\\?(.*))?$"), "/watch?v=$1&$2" });
+
+	const std::vector<std::string> twitterParams = { "s", "t", "ref_src", "ref_url" };
+	Add("twitter.com", { "", {}, twitterParams, {}, "" });
+	Add("x.com", { "twitter.com", {}, twitterParams, {}, "" });
+
+	const std::vector<std::string> redditParams = { "share_id", "rdt", "ref", "ref_source" };
+	Add("reddit.com", { "", {}, redditParams, {}, "" });
+	Add("old.reddit.com", { "reddit.com", {}, redditParams, {}, "" });
+
+	Add("open.spotify.com", { "", {}, { "si", "context" }, {}, "" });
+	Add("instagram.com", { "", {}, { "igsh", "img_index" }, {}, "" });
+}
+
+void URLCanonicalizer::Add(const std::string &host, const URLHostRule &rule)
+{
+	_rules[host] = rule;
+}
+
+std::string URLCanonicalizer::Canonicalize(const std::string &url, const URLHostRule *override) const
+{
+	auto schemeEnd = url.find("://");
+	if (schemeEnd == std::string::npos)
+		return url;
+
+	auto scheme = boost::to_lower_copy(url.substr(0, schemeEnd));
+	auto authorityStart = schemeEnd + 3;
+	auto authorityEnd = std::min(url.find_first_of("/?#", authorityStart), url.size());
+
+	// User info isn't part of the resource
+	auto authority = url.substr(authorityStart, authorityEnd - authorityStart);
+	auto userInfo = authority.rfind('@');
+	if (userInfo != std::string::npos)
+		authority.erase(0, userInfo + 1);
+
+	std::string port;
+	auto portStart = authority.rfind(':');
+	auto ipv6End = authority.rfind(']');
+	if (portStart != std::string::npos && (ipv6End == std::string::npos || portStart > ipv6End))
+	{
+		port = authority.substr(portStart + 1);
+		authority.resize(portStart);
+	}
+
+	if (port.empty() || (scheme == "http" && port == "80") || (scheme == "https" && port == "443"))
+		port.clear();
+	else
+		port = ":" + port;
+
+	auto host = normalizeHost(authority);
+
+	auto fragmentStart = std::min(url.find('#', authorityEnd), url.size());
+	auto fragment = url.substr(fragmentStart);
+	auto target = url.substr(authorityEnd, fragmentStart - authorityEnd);
+
+	const URLHostRule *rule = override;
+	if (!rule)
+	{
+		auto registered = _rules.find(host);
+		if (registered != _rules.end())
+			rule = &registered->second;
+	}
+
+	if (rule)
+	{
+		if (!rule->_host.empty())
+			host = rule->_host;
+
+		if (rule->_rewrite)
+			target = std::regex_replace(target, *rule->_rewrite, rule->_rewriteTo, std::regex_constants::format_first_only);
+	}
+
+	auto queryStart = std::min(target.find('?'), target.size());
+	auto path = target.substr(0, queryStart);
+	while (!path.empty() && path.back() == '/')
+		path.pop_back();
+
+	std::vector<std::pair<std::string, std::string>> params;
+	if (queryStart < target.size())
+	{
+		std::vector<std::string> pairs;
+		auto query = target.substr(queryStart + 1);
+		boost::split(pairs, query, boost::is_any_of("&"));
+		for (const auto &pair : pairs)
+		{
+			if (pair.empty())
+				continue;
+
+			auto name = pair.substr(0, pair.find('='));
+			bool keep = rule && !rule->_keepParams.empty()
+					? std::find(rule->_keepParams.begin(), rule->_keepParams.end(), name) != rule->_keepParams.end()
+					: !isTrackingParam(name)
+					  && !(rule && std::find(rule->_dropParams.begin(), rule->_dropParams.end(), name) != rule->_dropParams.end());
+
+			if (keep)
+				params.emplace_back(name, pair);
+		}
+	}
+
+	// Repeated parameters keep their relative order
+	std::stable_sort(params.begin(), params.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+
+	auto key = scheme + "://" + host + port + path;
+	for (size_t i = 0; i < params.size(); i++)
+		key += (i == 0 ? "?" : "&") + params[i].second;
+
+	// Hash-bang routes address different pages of single page apps
+	if (fragment.compare(0, 2, "#!") == 0)
+		key += fragment;
+
+	return key;
+}
+
+std::string URLCanonicalizer::GetHost(const std::string &url)
+{
+	auto schemeEnd = url.find("://");
+	auto authorityStart = schemeEnd == std::string::npos ? 0 : schemeEnd + 3;
+	auto authority = url.substr(authorityStart, url.find_first_of("/?#", authorityStart) - authorityStart);
+
+	auto userInfo = authority.rfind('@');
+	if (userInfo != std::string::npos)
+		authority.erase(0, userInfo + 1);
+
+	auto portStart = authority.rfind(':');
+	auto ipv6End = authority.rfind(']');
+	if (portStart != std::string::npos && (ipv6End == std::string::npos || portStart > ipv6End))
+		authority.resize(portStart);
+
+	return normalizeHost(authority);
+}
+
+std::string URLCanonicalizer::normalizeHost(std::string host)
+{
+	// Plain ASCII lowercasing, hosts are not localized text
+	boost::to_lower(host);
+	while (!host.empty() && host.back() == '.')
+		host.pop_back();
+
+	// Prefix only goes when a domain with a dot is left
+	for (const std::string prefix : { "www.", "m.", "mobile." })
+	{
+		if (host.compare(0, prefix.size(), prefix) == 0
+				&& host.find('.', prefix.size()) != std::string::npos)
+			host.erase(0, prefix.size());
+	}
+
+	return host;
+}
+
+bool URLCanonicalizer::isTrackingParam(const std::string &name)
+{
+	static const std::unordered_set<std::string> trackingParams = {
+		"fbclid", "gclid", "dclid", "gbraid", "wbraid", "yclid", "msclkid", "twclid",
+		"mc_cid", "mc_eid", "igshid", "_openstat", "_hsenc", "_hsmkt", "mkt_tok",
+	};
+
+	auto lowerName = boost::to_lower_copy(name);
+	return lowerName.compare(0, 4, "utm_") == 0 || trackingParams.count(lowerName) > 0;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(URLCanonicalizer, Generic)
+{
+	URLCanonicalizer canonicalizer;
+	EXPECT_EQ("https://example.com", canonicalizer.Canonicalize("https://example.com/"));
+	EXPECT_EQ("https://example.com", canonicalizer.Canonicalize("HTTPS://WWW.Example.COM:443/"));
+	EXPECT_EQ("http://example.com:8080/a", canonicalizer.Canonicalize("http://user@m.example.com:8080/a/#top"));
+	EXPECT_EQ("https://example.com/page?a=1&b=2&b=1",
+			  canonicalizer.Canonicalize("https://example.com/page/?utm_source=x&b=2&fbclid=y&a=1&b=1&UTM_Medium=z"));
+	EXPECT_EQ("https://example.com/app#!/item/1", canonicalizer.Canonicalize("https://example.com/app#!/item/1"));
+	EXPECT_EQ("https://m.com", canonicalizer.Canonicalize("https://www.m.com"));
+	EXPECT_EQ("not a url", canonicalizer.Canonicalize("not a url"));
+
+	EXPECT_EQ("example.com", URLCanonicalizer::GetHost("http://user:pw@www.Example.com:80/path"));
+	EXPECT_EQ("youtube.com", URLCanonicalizer::GetHost("https://m.youtube.com"));
+}
+
+TEST(URLCanonicalizer, HostRules)
+{
+	URLCanonicalizer canonicalizer;
+	const std::string video = "https://youtube.com/watch?v=abc-123";
+	EXPECT_EQ(video, canonicalizer.Canonicalize("https://youtu.be/abc-123"));
+	EXPECT_EQ(video, canonicalizer.Canonicalize("https://youtu.be/abc-123?si=xyz"));
+	EXPECT_EQ(video, canonicalizer.Canonicalize("https://www.youtube.com/watch?v=abc-123&feature=share"));
+	EXPECT_EQ(video, canonicalizer.Canonicalize("https://m.youtube.com/shorts/abc-123"));
+	EXPECT_EQ("https://youtube.com/watch?t=10&v=abc-123", canonicalizer.Canonicalize("https://youtu.be/abc-123?t=10"));
+	EXPECT_EQ("https://twitter.com/user/status/1", canonicalizer.Canonicalize("https://x.com/user/status/1?s=20&t=abc"));
+
+	auto rule = URLHostRule::Parse("host=example.org; keep=id");
+	ASSERT_TRUE(rule.has_value());
+	EXPECT_EQ("https://example.org/item?id=5", canonicalizer.Canonicalize("https://shop.example.com/item?ref=a&id=5", &*rule));
+
+	canonicalizer.Add("shop.example.com", *URLHostRule::Parse("drop=ref"));
+	EXPECT_EQ("https://shop.example.com/item?id=5", canonicalizer.Canonicalize("https://shop.example.com/item?ref=a&id=5"));
+
+	EXPECT_FALSE(URLHostRule::Parse("").has_value());
+	EXPECT_FALSE(URLHostRule::Parse("keep").has_value());
+	EXPECT_FALSE(URLHostRule::Parse("rename=x").has_value());
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <regex>
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * Per-host canonicalization rule.
+ *
+ * _host renames the host (youtu.be -> youtube.com), _rewrite is applied to
+ * "path?query" before parameters are filtered. With _keepParams set only
+ * those parameters survive, otherwise _dropParams are removed on top of the
+ * common tracking ones.
+ */
+class URLHostRule
+{
+public:
+	std::string _host;
+	std::vector<std::string> _keepParams;
+	std::vector<std::string> _dropParams;
+	std::optional<std::regex> _rewrite;
+	std::string _rewriteTo;
+
+	// "host=youtube.com; keep=v,list; drop=ref,source"
+	static std::optional<URLHostRule> Parse(const std::string &text);
+};
+
+/**
+ * Builds a canonical key for a URL, so links to the same resource share
+ * title cache entries and history rows.
+ *
+ * Scheme and host are lowercased, "www."/"m."/"mobile." host prefixes, default
+ * ports, fragments (except "#!" routes), trailing slashes and tracking
+ * parameters are dropped, remaining parameters are sorted by name.
+ * The key is only used for lookups, the original URL is still displayed and fetched.
+ */
+class URLCanonicalizer
+{
+public:
+	// Starts with the built-in host rules
+	URLCanonicalizer();
+
+	void Add(const std::string &host, const URLHostRule &rule);
+
+	// override replaces the rule registered for the host
+	std::string Canonicalize(const std::string &url, const URLHostRule *override = nullptr) const;
+
+	// Lowercased host without port and mobile/www prefixes, as rules are keyed
+	static std::string GetHost(const std::string &url);
+
+private:
+	static std::string normalizeHost(std::string host);
+	static bool isTrackingParam(const std::string &name);
+
+	std::unordered_map<std::string, URLHostRule> _rules;
+};
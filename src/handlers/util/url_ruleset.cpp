@@ -0,0 +1,243 @@
+#include "url_ruleset.h"
+
+#include <glog/logging.h>
+
+bool URLRuleSet::Add(int id, const std::string &pattern, bool blacklist)
+{
+	auto &rules = blacklist ? _blacklist : _whitelist;
+
+	if (isLiteral(pattern))
+	{
+		LiteralRule rule = { id, pattern, "", 0 };
+
+		size_t begin = 0;
+		while (begin <= pattern.size())
+		{
+			auto end = pattern.find('.', begin);
+			if (end == std::string::npos)
+				end = pattern.size();
+
+			if (end - begin > rule._anchor.size())
+			{
+				rule._anchor = pattern.substr(begin, end - begin);
+				rule._anchorOffset = begin;
+			}
+			begin = end + 1;
+		}
+
+		rules._literals.push_back(std::move(rule));
+		return true;
+	}
+
+	try {
+		rules._regexes.push_back({ id, pattern, std::regex(pattern, std::regex::ECMAScript | std::regex::optimize) });
+		return true;
+	} catch (std::regex_error &e) {
+		LOG(ERROR) << "Skipping invalid URL rule " << id << " (" << pattern << "): " << e.what();
+		return false;
+	}
+}
+
+bool URLRuleSet::ShouldPrint(const std::string &url) const
+{
+	// Whitelist match decides the outcome, no need to look further
+	if (auto rule = _whitelist.Find(url))
+	{
+		LOG(INFO) << "URL is whitelisted by rule: " << *rule;
+		return true;
+	}
+
+	if (auto rule = _blacklist.Find(url))
+	{
+		LOG(INFO) << "URL is blacklisted by rule: " << *rule;
+		return false;
+	}
+
+	return true;
+}
+
+size_t URLRuleSet::Size() const
+{
+	return _whitelist._literals.size() + _whitelist._regexes.size()
+			+ _blacklist._literals.size() + _blacklist._regexes.size();
+}
+
+bool URLRuleSet::LiteralRule::Matches(const std::string &url) const
+{
+	if (url.size() < _pattern.size())
+		return false;
+
+	// '.' matches any character except line terminators, same as in ECMAScript regex
+	auto verify = [&](size_t start) {
+		for (size_t i = 0; i < _pattern.size(); i++)
+		{
+			char c = url[start + i];
+			if (_pattern[i] == '.' ? (c == '\n' || c == '\r') : c != _pattern[i])
+				return false;
+		}
+		return true;
+	};
+
+	if (_anchor.empty())
+	{
+		for (size_t start = 0; start + _pattern.size() <= url.size(); start++)
+			if (verify(start))
+				return true;
+		return false;
+	}
+
+	for (auto pos = url.find(_anchor, _anchorOffset); pos != std::string::npos; pos = url.find(_anchor, pos + 1))
+	{
+		auto start = pos - _anchorOffset;
+		if (start + _pattern.size() > url.size())
+			return false;
+		if (verify(start))
+			return true;
+	}
+
+	return false;
+}
+
+const std::string *URLRuleSet::Rules::Find(const std::string &url) const
+{
+	for (const auto &rule : _literals)
+		if (rule.Matches(url))
+			return &rule._pattern;
+
+	for (const auto &rule : _regexes)
+		if (std::regex_search(url, rule._regex))
+			return &rule._pattern;
+
+	return nullptr;
+}
+
+bool URLRuleSet::isLiteral(const std::string &pattern)
+{
+	// '.' is handled by the literal matcher itself
+	return pattern.find_first_of("\\^$*+?()[]{}|") == std::string::npos;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace {
+
+bool naiveShouldPrint(const std::vector<std::pair<std::string, bool>> &rules, const std::string &url)
+{
+	bool blacklisted = false;
+	for (const auto &rule : rules)
+	{
+		if (std::regex_search(url, std::regex(rule.first)))
+		{
+			if (!rule.second)
+				return true;
+			blacklisted = true;
+		}
+	}
+	return !blacklisted;
+}
+
+std::vector<std::pair<std::string, bool>> makeRules(int count)
+{
+	std::vector<std::pair<std::string, bool>> rules;
+	for (int i = 0; i < count; i++)
+	{
+		auto n = std::to_string(i);
+		switch (i % 6)
+		{
+		case 0: rules.push_back({ "forum" + n + "\\.example\\.com/thread/\\d+", true }); break;
+		case 1: rules.push_back({ "^https://(www\\.)?video" + n + "\\.", false }); break;
+		default: rules.push_back({ "site" + n + ".example.org", i % 2 == 0 }); break;
+		}
+	}
+	return rules;
+}
+
+std::vector<std::string> makeURLs(int count)
+{
+	std::vector<std::string> urls;
+	for (int i = 0; i < count; i++)
+	{
+		auto n = std::to_string(i % 400);
+		switch (i % 4)
+		{
+		case 0: urls.push_back("http://forum" + n + ".example.com/thread/" + std::to_string(i)); break;
+		case 1: urls.push_back("https://www.video" + n + ".net/watch?v=" + std::to_string(i)); break;
+		case 2: urls.push_back("https://site" + n + "Xexample.org/page"); break;
+		default: urls.push_back("https://unrelated.example.net/site" + n + "/index.html"); break;
+		}
+	}
+	return urls;
+}
+
+}
+
+TEST(URLRuleSet, Literals)
+{
+	URLRuleSet rules;
+	EXPECT_TRUE(rules.Add(1, "example.com", true));
+	EXPECT_TRUE(rules.Add(2, "example.com/good", false));
+	EXPECT_TRUE(rules.Add(3, "...", true));
+	EXPECT_FALSE(rules.Add(4, "broken(", true));
+	EXPECT_EQ(3, rules.Size());
+
+	EXPECT_FALSE(rules.ShouldPrint("http://example.com/bad"));
+	EXPECT_FALSE(rules.ShouldPrint("http://exampleXcom/bad"));
+	EXPECT_TRUE(rules.ShouldPrint("http://example.com/good"));
+	EXPECT_FALSE(rules.ShouldPrint("http://a.b"));
+	EXPECT_TRUE(rules.ShouldPrint("ab"));
+
+	URLRuleSet empty;
+	EXPECT_TRUE(empty.ShouldPrint("http://example.com"));
+}
+
+TEST(URLRuleSet, SameAsRegex)
+{
+	auto rules = makeRules(300);
+	URLRuleSet compiled;
+	for (size_t i = 0; i < rules.size(); i++)
+		compiled.Add(i, rules[i].first, rules[i].second);
+
+	for (const auto &url : makeURLs(400))
+		EXPECT_EQ(naiveShouldPrint(rules, url), compiled.ShouldPrint(url)) << url;
+}
+
+// Run with --gtest_also_run_disabled_tests
+TEST(URLRuleSet, DISABLED_Benchmark)
+{
+	auto rules = makeRules(300);
+	auto urls = makeURLs(200);
+
+	auto start = std::chrono::steady_clock::now();
+	int printed = 0;
+	for (const auto &url : urls)
+		printed += naiveShouldPrint(rules, url);
+	auto naive = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	URLRuleSet compiled;
+	for (size_t i = 0; i < rules.size(); i++)
+		compiled.Add(i, rules[i].first, rules[i].second);
+	auto build = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	int compiledPrinted = 0;
+	for (int round = 0; round < 100; round++)
+		for (const auto &url : urls)
+			compiledPrinted += compiled.ShouldPrint(url);
+	auto lookup = (std::chrono::steady_clock::now() - start) / 100;
+
+	EXPECT_EQ(printed, compiledPrinted / 100);
+
+	using std::chrono::microseconds;
+	std::cout << urls.size() << " URLs against " << rules.size() << " rules:" << std::endl
+			  << "  regex per lookup: " << std::chrono::duration_cast<microseconds>(naive).count() << " us" << std::endl
+			  << "  compiled set:     " << std::chrono::duration_cast<microseconds>(lookup).count() << " us"
+			  << " (+" << std::chrono::duration_cast<microseconds>(build).count() << " us to build)" << std::endl;
+}
+
+#endif // LCOV_EXCL_STOP
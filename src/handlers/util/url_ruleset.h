@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <regex>
+
+/**
+ * Compiled set of URL white/blacklist rules.
+ *
+ * Rules are regular expressions. Most of them are plain host or path
+ * fragments, so rules without regex operators (other than '.') skip std::regex
+ * and are matched by searching for their longest literal run. The rest are
+ * compiled once when added instead of on every lookup.
+ */
+class URLRuleSet
+{
+public:
+	bool Add(int id, const std::string &pattern, bool blacklist);
+
+	// A URL is printed unless it matches a blacklist rule and no whitelist rule
+	bool ShouldPrint(const std::string &url) const;
+
+	size_t Size() const;
+
+private:
+	class LiteralRule
+	{
+	public:
+		int _id;
+		std::string _pattern;
+		std::string _anchor;       // longest run without '.'
+		size_t _anchorOffset = 0;
+
+		bool Matches(const std::string &url) const;
+	};
+
+	class RegexRule
+	{
+	public:
+		int _id;
+		std::string _pattern;
+		std::regex _regex;
+	};
+
+	class Rules
+	{
+	public:
+		std::vector<LiteralRule> _literals;
+		std::vector<RegexRule> _regexes;
+
+		const std::string *Find(const std::string &url) const;
+	};
+
+	static bool isLiteral(const std::string &pattern);
+
+	Rules _whitelist;
+	Rules _blacklist;
+};
@@ -59,6 +59,39 @@ void Voting::HandlePresence(const std::string &from, const std::string &jid, boo
 	}
 }
 
+void Voting::HandlePresenceBatch(const std::vector<PresenceUpdate> &batch)
+{
+	if (_activePolls.empty())
+		return;
+
+	// Invitations are looked up in the arrived set instead of scanning polls per occupant
+	std::unordered_map<std::string, std::string> arrived;
+	for (const auto &presence : batch)
+	{
+		if (!presence._online)
+			continue;
+		arrived.emplace(presence._jid, presence._nick);
+		arrived.emplace(presence._nick, presence._nick);
+	}
+
+	for (auto &poll : _activePolls)
+	{
+		auto &invitations = poll.second._invitations;
+		for (auto invite = invitations.begin(); invite != invitations.end(); )
+		{
+			auto nick = arrived.find(*invite);
+			if (nick == arrived.end())
+			{
+				++invite;
+				continue;
+			}
+
+			SendMessage(nick->second + " you've been invited to vote on poll " + poll.first + "\n" + poll.second.Print(false));
+			invite = invitations.erase(invite);
+		}
+	}
+}
+
 const std::string Voting::GetHelp() const
 {
 	return "!polls - list polls\n"
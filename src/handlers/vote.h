@@ -29,6 +29,7 @@ public:
 
 	ProcessingResult HandleMessage(const ChatMessage &msg) final;
 	void HandlePresence(const std::string &from, const std::string &jid, bool connected) override;
+	void HandlePresenceBatch(const std::vector<PresenceUpdate> &batch) override;
 	const std::string GetHelp() const override;
 
 private:
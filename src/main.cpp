@@ -16,6 +16,7 @@
 #include "handlers/util/thread_util.h"
 
 #include <cpptoml.h>
+#include <sqlite3.h>
 
 void InitGLOG(char **argv, const std::string &prefix)
 {
@@ -33,6 +34,9 @@ int main(int argc, char **argv)
 {
 	initLocale();
 
+	// Needed to attach module databases read-only, must precede any sqlite use
+	sqlite3_config(SQLITE_CONFIG_URI, 1);
+
 	std::string configPath = "/etc/lemongrab/config.toml";
 	bool cliTestMode = false;
 
@@ -0,0 +1,338 @@
+#include "storagepool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+
+#include <glog/logging.h>
+#include <sqlite3.h>
+
+#include "settings.h"
+#include "handlers/util/sqlite_backup.h"
+#include "handlers/util/sqlite_connection.h"
+#include "handlers/util/sqlite_migrations.h"
+#include "handlers/util/stringops.h"
+
+// Tables owned by each module in the single-file layout
+static const std::unordered_map<std::string, std::vector<std::string>> legacyTables = {
+	{ "rss", { "rss" } },
+	{ "url", { "url_rules", "url_log" } },
+	{ "quotes", { "quotes" } },
+	{ "pager", { "pager" } },
+	{ "leaugelookup", { "summoners" } },
+	{ "seen", { "nicks", "useractivity" } },
+};
+
+static std::string quoteSQLString(const std::string &input)
+{
+	std::string output = "'";
+	for (auto c : input)
+	{
+		if (c == '\'')
+			output += '\'';
+		output += c;
+	}
+	return output + "'";
+}
+
+StoragePool::StoragePool(const std::string &pathPrefix, const Settings &settings)
+	: _pathPrefix(pathPrefix)
+	, _settings(settings)
+{
+
+}
+
+Storage &StoragePool::Get(const std::string &module)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	auto existing = _storages.find(module);
+	if (existing != _storages.end())
+		return *existing->second;
+
+	auto path = GetPath(module);
+	auto storagePath = path;
+	if (!std::ifstream(path).good() && !ImportLegacyTables(module, path))
+	{
+		// Module file isn't created, so the import is retried on next start
+		LOG(ERROR) << "Failed to import legacy data for module " << module
+				   << ", it runs on an in-memory database until the import succeeds";
+		storagePath = ":memory:";
+		_inMemory.insert(module);
+	}
+
+	auto slowQueryMs = from_string<int>(GetModuleConfig(module, "SlowQueryMs")).value_or(defaultSlowQueryMs);
+	auto slowQueryTop = from_string<int>(GetModuleConfig(module, "SlowQueryTop")).value_or(defaultSlowQueryTop);
+	auto &profiler = _profilers[module];
+	// Plans are explained against the database the module actually runs on
+	profiler = std::make_unique<QueryProfiler>(storagePath, std::chrono::milliseconds(slowQueryMs), std::max(slowQueryTop, 1));
+
+	auto storage = OpenStorage(module, storagePath, profiler.get());
+	if (!MigrateDatabase(storagePath, *storage))
+		LOG(ERROR) << "Database schema migration failed for " << path;
+
+	return *_storages.emplace(module, std::move(storage)).first->second;
+}
+
+StorageWorker &StoragePool::GetWorker(const std::string &module)
+{
+	auto &storage = Get(module);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto &worker = _workers[module];
+	if (worker)
+		return *worker;
+
+	// In-memory fallback can't be opened twice, its jobs run on the calling thread instead
+	if (_inMemory.count(module) > 0)
+	{
+		worker = std::make_unique<StorageWorker>(storage);
+		return *worker;
+	}
+
+	// Second connection to the same WAL file, so worker batches never interleave with handler statements
+	auto &workerStorage = _workerStorages[module];
+	workerStorage = OpenStorage(module, GetPath(module), _profilers[module].get());
+	worker = std::make_unique<StorageWorker>(*workerStorage, "db " + module);
+	return *worker;
+}
+
+std::unique_ptr<Storage> StoragePool::OpenStorage(const std::string &module, const std::string &path, QueryProfiler *profiler)
+{
+	auto storage = std::unique_ptr<Storage>(new Storage(initStorage(path)));
+	storage->on_open = [this, module, profiler](sqlite3 *db) {
+		ConfigureConnection(db, module);
+		profiler->Attach(db);
+	};
+	storage->open_forever();
+	return storage;
+}
+
+std::string StoragePool::GetPath(const std::string &module) const
+{
+	return _pathPrefix + "/" + module + ".db";
+}
+
+std::optional<int> StoragePool::Backup(int keep)
+{
+	std::unique_lock<std::mutex> backupLock(_backupMutex, std::try_to_lock);
+	if (!backupLock.owns_lock())
+		return {};
+
+	std::vector<std::string> modules;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (const auto &storage : _storages)
+			modules.push_back(storage.first);
+	}
+
+	keep = std::max(keep, 1);
+	int done = 0;
+	for (const auto &module : modules)
+	{
+		// Older snapshots are only rotated (N-1 -> N, ..., 0 -> 1) once the new one is complete
+		auto fresh = GetSnapshotPath(module, 0);
+		if (!BackupDatabase(GetPath(module), fresh))
+		{
+			LOG(ERROR) << "Backup of module " << module << " failed";
+			continue;
+		}
+
+		std::remove(GetSnapshotPath(module, keep).c_str());
+		for (int generation = keep - 1; generation >= 0; generation--)
+			std::rename(GetSnapshotPath(module, generation).c_str(), GetSnapshotPath(module, generation + 1).c_str());
+		done++;
+	}
+
+	LOG(INFO) << "Database backup finished: " << done << " of " << modules.size() << " modules";
+	return done;
+}
+
+std::string StoragePool::GetQueryReport()
+{
+	// Reports run EXPLAIN, modules may be opened meanwhile
+	std::vector<QueryProfiler*> profilers;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (const auto &profiler : _profilers)
+			profilers.push_back(profiler.second.get());
+	}
+
+	if (profilers.empty())
+		return "No databases opened yet";
+
+	std::string report;
+	for (auto profiler : profilers)
+	{
+		if (!report.empty())
+			report += "\n";
+		report += profiler->Report();
+	}
+	return report;
+}
+
+std::string StoragePool::GetSnapshotPath(const std::string &module, int generation) const
+{
+	return _pathPrefix + "/" + module + ".snapshot-" + std::to_string(generation) + ".db";
+}
+
+void StoragePool::ConfigureConnection(sqlite3 *db, const std::string &module) const
+{
+	auto checkpoint = from_string<int>(GetModuleConfig(module, "WalAutocheckpoint")).value_or(defaultWalAutocheckpoint);
+
+	std::string pragmas = "PRAGMA journal_mode = WAL;"
+						  "PRAGMA synchronous = NORMAL;"
+						  "PRAGMA wal_autocheckpoint = " + std::to_string(checkpoint) + ";";
+
+	// Cross-module queries get other module files attached read-only
+	for (const auto &attached : _settings.GetStringSet("Database." + module + ".Attach"))
+	{
+		if (attached != module)
+			pragmas += "ATTACH DATABASE " + quoteSQLString("file:" + GetPath(attached) + "?mode=ro") + " AS \"" + attached + "\";";
+	}
+
+	sqlite3_busy_timeout(db, 5000);
+
+	char *error = nullptr;
+	if (sqlite3_exec(db, pragmas.c_str(), nullptr, nullptr, &error) != SQLITE_OK)
+	{
+		LOG(ERROR) << "Failed to configure connection for " << module << ": " << (error ? error : "unknown");
+		sqlite3_free(error);
+	}
+}
+
+bool StoragePool::ImportLegacyTables(const std::string &module, const std::string &path) const
+{
+	auto tables = legacyTables.find(module);
+	auto legacyPath = _pathPrefix + "/local.db";
+	if (tables == legacyTables.end() || !std::ifstream(legacyPath).good())
+		return true;
+
+	LOG(WARNING) << "Importing " << module << " data from " << legacyPath << " to " << path;
+
+	// Import goes to a temporary file, so a failed one is retried on next start
+	// instead of leaving an empty module file behind
+	auto temporaryPath = path + ".tmp";
+	std::remove(temporaryPath.c_str());
+	bool imported = importLegacyTables(tables->second, legacyPath, temporaryPath);
+	if (imported && std::rename(temporaryPath.c_str(), path.c_str()) == 0)
+		return true;
+
+	std::remove(temporaryPath.c_str());
+	return false;
+}
+
+bool StoragePool::importLegacyTables(const std::vector<std::string> &tables, const std::string &legacyPath, const std::string &path)
+{
+	SQLiteConnection db(path);
+	if (!db.Execute("ATTACH DATABASE " + quoteSQLString(legacyPath) + " AS legacy"))
+		return false;
+
+	bool success = db.Execute("BEGIN");
+	for (const auto &table : tables)
+	{
+		std::string createStatement;
+		success = success && db.Query("SELECT sql FROM legacy.sqlite_master WHERE type = 'table' AND name = " + quoteSQLString(table),
+									  [&](const std::vector<std::string> &row) { createStatement = row.at(0); });
+
+		if (!success || createStatement.empty())
+			continue;
+
+		success = db.Execute(createStatement)
+				&& db.Execute("INSERT INTO main.\"" + table + "\" SELECT * FROM legacy.\"" + table + "\"");
+	}
+
+	// Legacy schema version tells migrations where to start from
+	auto version = db.QueryInt("PRAGMA legacy.user_version");
+	success = success && version && db.Execute("PRAGMA main.user_version = " + std::to_string(*version));
+
+	if (!success || !db.Execute("COMMIT"))
+	{
+		db.Execute("ROLLBACK");
+		return false;
+	}
+
+	return db.Execute("DETACH DATABASE legacy");
+}
+
+std::string StoragePool::GetModuleConfig(const std::string &module, const std::string &name) const
+{
+	auto value = _settings.GetRawString("Database." + module + "." + name);
+	return value.empty() ? _settings.GetRawString("Database." + name) : value;
+}
+
+#ifdef _BUILD_TESTS // LCOV_EXCL_START
+
+#include <gtest/gtest.h>
+
+TEST(StoragePool, LegacyImport)
+{
+	Settings settings;
+	ASSERT_TRUE(settings.Open("test/config.toml.test"));
+
+	std::remove("testdb/local.db");
+	std::remove("testdb/quotes.db");
+	std::remove("testdb/pager.db");
+
+	{
+		auto legacy = initStorage("testdb/local.db");
+		legacy.sync_schema();
+		DB::Quote quote = { -1, 1, "legacy quote", "", "" };
+		legacy.insert(quote);
+	}
+
+	StoragePool pool("testdb", settings);
+
+	EXPECT_EQ(1, pool.Get("quotes").count<DB::Quote>());
+	EXPECT_EQ(0, pool.Get("pager").count<DB::Quote>());
+	EXPECT_EQ(&pool.Get("quotes"), &pool.Get("quotes"));
+	EXPECT_EQ("testdb/quotes.db", pool.GetPath("quotes"));
+}
+
+TEST(StoragePool, FailedLegacyImport)
+{
+	Settings settings;
+	ASSERT_TRUE(settings.Open("test/config.toml.test"));
+
+	std::remove("testdb/rss.db");
+	std::ofstream("testdb/local.db", std::ios::trunc) << "not a database";
+
+	{
+		StoragePool pool("testdb", settings);
+		EXPECT_EQ(0, pool.Get("rss").count<DB::RssFeed>());
+	}
+
+	// Nothing is left behind, next start tries again
+	EXPECT_FALSE(std::ifstream("testdb/rss.db").good());
+	EXPECT_FALSE(std::ifstream("testdb/rss.db.tmp").good());
+	std::remove("testdb/local.db");
+}
+
+TEST(StoragePool, BackupRotation)
+{
+	Settings settings;
+	ASSERT_TRUE(settings.Open("test/config.toml.test"));
+
+	StoragePool pool("testdb", settings);
+	for (int generation = 0; generation <= 3; generation++)
+		std::remove(pool.GetSnapshotPath("backuptest", generation).c_str());
+
+	DB::Quote quote = { -1, 1, "first", "", "" };
+	pool.Get("backuptest").insert(quote);
+	EXPECT_EQ(1, pool.Backup(2).value_or(0));
+
+	quote.quote = "second";
+	pool.Get("backuptest").insert(quote);
+	EXPECT_EQ(1, pool.Backup(2).value_or(0));
+	EXPECT_EQ(1, pool.Backup(2).value_or(0));
+
+	EXPECT_TRUE(std::ifstream(pool.GetSnapshotPath("backuptest", 2)).good());
+	EXPECT_FALSE(std::ifstream(pool.GetSnapshotPath("backuptest", 3)).good());
+	EXPECT_FALSE(std::ifstream(pool.GetSnapshotPath("backuptest", 0)).good());
+
+	auto snapshot = initStorage(pool.GetSnapshotPath("backuptest", 1));
+	EXPECT_EQ(pool.Get("backuptest").count<DB::Quote>(), snapshot.count<DB::Quote>());
+}
+
+#endif // LCOV_EXCL_STOP
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "handlers/util/sqlite_db.h"
+#include "handlers/util/query_profiler.h"
+#include "handlers/util/storage_worker.h"
+
+class Settings;
+
+/**
+ * Every module gets its own database file (%DBPathPrefix%/%module%.db) with
+ * its own connection, WAL and checkpoint settings, so writes from unrelated
+ * modules don't contend for the same lock.
+ *
+ * All files share the Storage schema (tables of other modules stay empty).
+ * Data of a module is copied from the legacy local.db the first time its file is created.
+ *
+ * Statements of every module are timed, slow ones are kept by its QueryProfiler.
+ * Background jobs of a module run on its own StorageWorker thread with a separate connection.
+ */
+class StoragePool
+{
+public:
+	StoragePool(const std::string &pathPrefix, const Settings &settings);
+
+	Storage &Get(const std::string &module);
+	StorageWorker &GetWorker(const std::string &module);
+	std::string GetPath(const std::string &module) const;
+
+	// Snapshots every opened module to %module%.snapshot-N.db, keeping last N copies.
+	// A failed snapshot leaves older ones untouched
+	// Returns number of modules backed up or nothing if another backup is running
+	std::optional<int> Backup(int keep);
+	std::string GetSnapshotPath(const std::string &module, int generation) const;
+
+	// Slow query tables of all opened modules
+	std::string GetQueryReport();
+
+private:
+	std::unique_ptr<Storage> OpenStorage(const std::string &module, const std::string &path, QueryProfiler *profiler);
+	void ConfigureConnection(sqlite3 *db, const std::string &module) const;
+	bool ImportLegacyTables(const std::string &module, const std::string &path) const;
+	static bool importLegacyTables(const std::vector<std::string> &tables, const std::string &legacyPath, const std::string &path);
+	std::string GetModuleConfig(const std::string &module, const std::string &name) const;
+
+	std::string _pathPrefix;
+	const Settings &_settings;
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, std::unique_ptr<QueryProfiler>> _profilers; // must outlive storages
+	std::unordered_map<std::string, std::unique_ptr<Storage>> _storages;
+	std::unordered_map<std::string, std::unique_ptr<Storage>> _workerStorages;
+	std::unordered_map<std::string, std::unique_ptr<StorageWorker>> _workers; // drained before storages close
+	std::unordered_set<std::string> _inMemory; // modules whose legacy import failed
+	std::mutex _backupMutex;
+
+	static constexpr int defaultWalAutocheckpoint = 1000;
+	static constexpr int defaultSlowQueryMs = 50;
+	static constexpr int defaultSlowQueryTop = 10;
+};
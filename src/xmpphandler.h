@@ -2,6 +2,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 class ChatMessage
 {
@@ -30,6 +31,15 @@ public:
 	std::string _module_name;
 };
 
+class PresenceUpdate
+{
+public:
+	std::string _nick;
+	std::string _jid;
+	bool _online = false;
+	std::string _newNick;
+};
+
 class XMPPHandler
 {
 public:
@@ -38,4 +48,13 @@ public:
 	virtual void OnConnect() = 0;
 	virtual void OnMessage(ChatMessage &msg) = 0;
 	virtual void OnPresence(const std::string &nick, const std::string &jid, bool online, const std::string &newNick) = 0;
+
+	/**
+	 * @brief Occupant list received on room join, delivered at once
+	 */
+	virtual void OnPresenceBatch(const std::vector<PresenceUpdate> &batch)
+	{
+		for (const auto &presence : batch)
+			OnPresence(presence._nick, presence._jid, presence._online, presence._newNick);
+	}
 };